@@ -27,7 +27,8 @@ public:
         , weight_{weight}
     {
         if (weight_ == 0.0)
-            throw std::runtime_error("constraint weight cannot be zero");
+            RHEA_THROW(
+                std::runtime_error("constraint weight cannot be zero"));
     }
 
     virtual ~abstract_constraint() {}
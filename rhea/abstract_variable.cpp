@@ -8,6 +8,51 @@
 namespace rhea
 {
 
-size_t abstract_variable::count_ = 0;
+std::atomic<std::uint64_t> abstract_variable::count_{0};
+
+namespace
+{
+
+thread_local id_block* current_block = nullptr;
+
+} // anonymous namespace
+
+id_block::id_block(size_t index)
+{
+    if (index == 0 || index > max_index())
+        RHEA_THROW(std::out_of_range("id_block index out of range"));
+
+    next_ = first_block_id() + (index - 1) * size();
+    end_ = next_ + size();
+}
+
+id_block::scope::scope(id_block& block)
+    : previous_{current_block}
+{
+    current_block = &block;
+}
+
+id_block::scope::~scope()
+{
+    current_block = previous_;
+}
+
+std::uint64_t abstract_variable::next_id()
+{
+    // Two variables with the same id would be taken for one and the same
+    // by the solver, so running out of ids is fatal.
+    if (!current_block) {
+        std::uint64_t id = ++count_;
+        if (id >= id_block::first_block_id())
+            RHEA_THROW(std::out_of_range("out of variable ids"));
+
+        return id;
+    }
+
+    if (current_block->next_ + 1 >= current_block->end_)
+        RHEA_THROW(std::out_of_range("out of ids in id_block"));
+
+    return ++current_block->next_;
+}
 
 } // namespace rhea
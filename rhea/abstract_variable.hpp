@@ -6,25 +6,83 @@
 //---------------------------------------------------------------------------
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <string>
 #include "errors.hpp"
 
 namespace rhea
 {
 
+/** A range of variable ids of its own.
+ * Variables are ordered by their ids, and the solver's hash tables use
+ * them as well.  Normally the ids are handed out by a global counter,
+ * so if more than one thread creates variables, the ids of a solver's
+ * variables depend on what the other threads were doing, and so can
+ * the solutions of ambiguous constraints.
+ *
+ * While an id_block::scope is active on a thread, all the variables
+ * that are created on that thread take their ids from the block,
+ * including the slack variables a solver makes for its constraints.
+ * Give every document its own block and use it whenever its constraints
+ * are built, and its variables get the same ids however the threads
+ * interleave.  A block must not be used on two threads at the same
+ * time.
+ *
+ * Ids are 64 bits wide on every platform.  The global counter uses the
+ * lower half of the range, and the blocks the upper half. */
+class id_block
+{
+public:
+    /** \param index  The number of the block, from 1 to max_index()
+     * \throws std::out_of_range if \a index is not in that range */
+    explicit id_block(size_t index);
+
+    /** Use a block for the variables created on this thread, for as
+     ** long as the scope exists. */
+    class scope
+    {
+    public:
+        explicit scope(id_block& block);
+        ~scope();
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+    private:
+        id_block* previous_;
+    };
+
+    /** The number of ids in a block.  Creating more variables than this
+     ** while a block is active throws std::out_of_range. */
+    static std::uint64_t size() { return std::uint64_t(1) << 32; }
+
+    /** The highest block index. */
+    static size_t max_index() { return (size_t(1) << 31) - 1; }
+
+private:
+    friend class abstract_variable;
+
+    /** The first id that belongs to a block. */
+    static std::uint64_t first_block_id() { return std::uint64_t(1) << 63; }
+
+    std::uint64_t next_;
+    std::uint64_t end_;
+};
+
 /** Base class for variables. */
 class abstract_variable
 {
 public:
     abstract_variable()
-        : id_{++count_}
+        : id_{next_id()}
     {
     }
 
     virtual ~abstract_variable() {}
 
-    size_t id() const { return id_; }
+    std::uint64_t id() const { return id_; }
 
     /** Return true if this is a floating point variable.
      * \sa float_variable */
@@ -46,7 +104,8 @@ public:
      * \sa simplex_solver::pivot() */
     virtual bool is_pivotable() const
     {
-        throw too_difficult("variable not usable inside simplex_solver");
+        RHEA_THROW(
+            too_difficult("variable not usable inside simplex_solver"));
     }
 
     /** Return true if this is a restricted (or slack) variable.
@@ -55,7 +114,8 @@ public:
      * \sa slack_variable */
     virtual bool is_restricted() const
     {
-        throw too_difficult("variable not usable inside simplex_solver");
+        RHEA_THROW(
+            too_difficult("variable not usable inside simplex_solver"));
     }
 
     /** Get the value of this variable. */
@@ -73,12 +133,17 @@ public:
     /** Get the value as a string. */
     virtual std::string to_string() const { return "abstract"; }
 
+private:
+    static std::uint64_t next_id();
+
 private:
     // Not happy with this, but it appears the algorithm needs this to run
     // with the autosolver turned off.  (Expression terms need a stable
-    // iteration order, see also Github issue #16.)
-    static size_t count_;
-    size_t id_;
+    // iteration order, see also Github issue #16.)  Solvers can run on
+    // different threads, so the counter is atomic.  It is not used while
+    // an id_block is active.
+    static std::atomic<std::uint64_t> count_;
+    std::uint64_t id_;
 };
 
 } // namespace rhea
@@ -0,0 +1,168 @@
+//---------------------------------------------------------------------------
+// async_solver.cpp
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#include "async_solver.hpp"
+
+#include "errors.hpp"
+
+namespace rhea
+{
+
+async_solver::async_solver(simplex_solver solver)
+    : solver_(std::move(solver))
+    , generation_{0}
+    , latest_{std::make_shared<solution>()}
+    , submitted_{0}
+    , finished_{0}
+    , stop_{false}
+{
+    thread_ = std::thread([this] { run(); });
+}
+
+async_solver::~async_solver()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_.notify_one();
+    thread_.join();
+}
+
+void async_solver::suggest(const variable& v, double x)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto ins = suggested_.emplace(v, suggestions_.size());
+        if (ins.second)
+            suggestions_.emplace_back(v, x);
+        else
+            suggestions_[ins.first->second].second = x;
+
+        ++submitted_;
+    }
+    work_.notify_one();
+}
+
+std::future<void> async_solver::modify(command f)
+{
+    std::future<void> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commands_.push_back({std::move(f), std::promise<void>()});
+        result = commands_.back().done.get_future();
+        ++submitted_;
+    }
+    work_.notify_one();
+    return result;
+}
+
+void async_solver::watch(const constraint& c)
+{
+    modify([this, c](simplex_solver&) { watched_.insert(c); });
+}
+
+std::shared_ptr<const solution> async_solver::latest() const
+{
+    return std::atomic_load(&latest_);
+}
+
+std::shared_ptr<const solution> async_solver::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return finished_ == submitted_; });
+    return latest();
+}
+
+void async_solver::run()
+{
+    publish();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        work_.wait(lock, [this] { return stop_ || finished_ != submitted_; });
+        if (finished_ == submitted_)
+            return;
+
+        std::vector<pending> commands;
+        std::vector<std::pair<variable, double>> suggestions;
+        commands.swap(commands_);
+        suggestions.swap(suggestions_);
+        suggested_.clear();
+        size_t ticket = submitted_;
+        lock.unlock();
+
+        apply(commands, suggestions);
+        publish();
+
+        lock.lock();
+        finished_ = ticket;
+        idle_.notify_all();
+    }
+}
+
+void async_solver::apply(
+    std::vector<pending>& commands,
+    std::vector<std::pair<variable, double>>& suggestions)
+{
+    // A failing command is reported through its own future, and doesn't
+    // keep the rest of the batch from being applied.
+    for (auto& c : commands) {
+#if RHEA_HAS_EXCEPTIONS
+        try {
+            c.f(solver_);
+        }
+        catch (...) {
+            c.done.set_exception(std::current_exception());
+            continue;
+        }
+#else
+        c.f(solver_);
+#endif
+        c.done.set_value();
+    }
+
+    std::vector<variable> vars;
+    std::vector<double> values;
+    for (auto& s : suggestions) {
+        if (solver_.try_hold_edit_var(s.first) != status::ok)
+            continue;
+
+        vars.push_back(s.first);
+        values.push_back(s.second);
+    }
+    if (vars.empty())
+        return;
+
+    solver_.try_suggest_values(vars, values);
+    solver_.resolve();
+}
+
+void async_solver::publish()
+{
+    auto result = std::make_shared<solution>();
+    result->generation_ = generation_++;
+
+    // The solver has already copied its results into the external
+    // variables, and nothing else writes them.
+    for (auto& row : solver_.rows()) {
+        if (row.first.is_external())
+            result->values_.emplace(row.first, row.first.value());
+    }
+    for (auto& col : solver_.columns()) {
+        if (col.first.is_external())
+            result->values_.emplace(col.first, col.first.value());
+    }
+    for (auto& c : watched_) {
+        if (solver_.contains_constraint(c)
+            && solver_.is_constraint_satisfied(c))
+            result->satisfied_.insert(c);
+    }
+
+    std::atomic_store(&latest_,
+                      std::shared_ptr<const solution>(std::move(result)));
+}
+
+} // namespace rhea
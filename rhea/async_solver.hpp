@@ -0,0 +1,152 @@
+//---------------------------------------------------------------------------
+/// \file   async_solver.hpp
+/// \brief  A solver that runs on a thread of its own
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "simplex_solver.hpp"
+
+namespace rhea
+{
+
+/** The values of the variables of a solver at one point in time.
+ * Solutions are never changed after they have been published, so any
+ * number of threads can read them. */
+class solution
+{
+public:
+    solution()
+        : generation_{0}
+    {
+    }
+
+    /** The number of solves that came before this one. */
+    size_t generation() const { return generation_; }
+
+    /** Check if the solution has a value for a variable. */
+    bool contains(const variable& v) const { return values_.count(v) > 0; }
+
+    /** Get the value of a variable.
+     * \return The value, or 0 if the variable is not in the solver */
+    double value(const variable& v) const
+    {
+        auto i = values_.find(v);
+        return i == values_.end() ? 0.0 : i->second;
+    }
+
+    /** Check if a constraint was satisfied.
+     * Only the constraints that were passed to async_solver::watch()
+     * are known, this returns false for all others. */
+    bool is_satisfied(const constraint& c) const
+    {
+        return satisfied_.count(c) > 0;
+    }
+
+private:
+    friend class async_solver;
+
+    size_t generation_;
+    std::unordered_map<variable, double> values_;
+    std::unordered_set<constraint> satisfied_;
+};
+
+/** A front end that runs a simplex_solver on a thread of its own.
+ * The application submits edits and changes, and goes on with what it
+ * was doing while the solver thread works through them.  Every time
+ * the solver thread has caught up, it publishes a new solution.  The
+ * renderer, hit testing, or anything else can read the latest solution
+ * at any time, also while the next one is being solved.
+ *
+ * Once the solver has been handed over, it and the values of its
+ * variables belong to the solver thread: variable::value() must not be
+ * used on other threads, use the published solutions instead. */
+class async_solver
+{
+public:
+    typedef std::function<void(simplex_solver&)> command;
+
+    /** Start the solver thread.
+     * \param solver  The solver to run */
+    explicit async_solver(simplex_solver solver = simplex_solver());
+
+    /** Finish the work that was submitted, and stop the thread. */
+    ~async_solver();
+
+    async_solver(const async_solver&) = delete;
+    async_solver& operator=(const async_solver&) = delete;
+
+    /** Suggest a new value for a variable.
+     * The variable becomes a held edit variable of the solver if it
+     * isn't one yet.  If the solver thread hasn't picked up an earlier
+     * suggestion for the same variable yet, that one is replaced.  The
+     * suggestion is ignored if the variable cannot be edited. */
+    void suggest(const variable& v, double x);
+
+    /** Run a function on the solver thread, for instance to add or
+     ** remove constraints.
+     * Commands run in the order they were submitted, and before the
+     * suggestions that were submitted together with them.  A command
+     * that fails doesn't stop the ones after it.
+     * \return A future that becomes ready once the command has run, and
+     *         holds its exception if it failed */
+    std::future<void> modify(command f);
+
+    /** Publish if a constraint is satisfied. */
+    void watch(const constraint& c);
+
+    /** Get the latest solution.
+     * This never waits for the solver thread. */
+    std::shared_ptr<const solution> latest() const;
+
+    /** Wait until everything that was submitted so far has been solved.
+     * \return The solution that includes all submitted changes */
+    std::shared_ptr<const solution> wait();
+
+private:
+    void run();
+
+    // Apply the submitted work, on the solver thread.
+    struct pending
+    {
+        command f;
+        std::promise<void> done;
+    };
+
+    void apply(std::vector<pending>& commands,
+               std::vector<std::pair<variable, double>>& suggestions);
+
+    void publish();
+
+private:
+    simplex_solver solver_;
+    std::unordered_set<constraint> watched_;
+    size_t generation_;
+    std::shared_ptr<const solution> latest_;
+
+    std::mutex mutex_;
+    std::condition_variable work_;
+    std::condition_variable idle_;
+    std::vector<pending> commands_;
+    std::vector<std::pair<variable, double>> suggestions_;
+    std::unordered_map<variable, size_t> suggested_;
+    size_t submitted_;
+    size_t finished_;
+    bool stop_;
+
+    std::thread thread_;
+};
+
+} // namespace rhea
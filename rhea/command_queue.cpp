@@ -0,0 +1,129 @@
+//---------------------------------------------------------------------------
+// command_queue.cpp
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#include "command_queue.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace rhea
+{
+
+void command_queue::free_list::operator()(node* n) const
+{
+    while (n) {
+        node* next = n->next;
+        delete n;
+        n = next;
+    }
+}
+
+command_queue::~command_queue()
+{
+    free_list()(head_.load(std::memory_order_acquire));
+}
+
+void command_queue::add_constraint(const constraint& c)
+{
+    push(new node{kind::add, c, variable::nil_var(), 0.0, nullptr});
+}
+
+void command_queue::remove_constraint(const constraint& c)
+{
+    push(new node{kind::remove, c, variable::nil_var(), 0.0, nullptr});
+}
+
+void command_queue::suggest_value(const variable& v, double x)
+{
+    push(new node{kind::suggest, constraint(), v, x, nullptr});
+}
+
+void command_queue::push(node* n)
+{
+    n->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(n->next, n,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed))
+        ;
+}
+
+status command_queue::drain(simplex_solver& solver)
+{
+    // Take the whole list at once, and put it back in submission order.
+    // The nodes are freed when this returns, whichever way it does.
+    std::unique_ptr<node, free_list> taken{
+        head_.exchange(nullptr, std::memory_order_acquire)};
+    std::vector<const node*> batch;
+    for (const node* n = taken.get(); n; n = n->next)
+        batch.push_back(n);
+
+    std::reverse(batch.begin(), batch.end());
+
+    // Cancel every removal against the last addition of the same
+    // constraint that hasn't been cancelled yet, and keep only the last
+    // suggestion for every variable.
+    std::vector<bool> skip(batch.size(), false);
+    std::unordered_map<constraint, size_t> added;
+    std::unordered_map<variable, size_t> suggested;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const node* n = batch[i];
+        if (n->what == kind::add) {
+            added[n->c] = i;
+        } else if (n->what == kind::remove) {
+            auto found = added.find(n->c);
+            if (found != added.end()) {
+                skip[found->second] = true;
+                skip[i] = true;
+                added.erase(found);
+            }
+        } else {
+            auto ins = suggested.emplace(n->v, i);
+            if (!ins.second) {
+                skip[ins.first->second] = true;
+                ins.first->second = i;
+            }
+        }
+    }
+
+    status result{status::ok};
+    auto report = [&](status s) {
+        if (result == status::ok)
+            result = s;
+    };
+
+    std::vector<variable> vars;
+    std::vector<double> values;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const node* n = batch[i];
+        if (skip[i])
+            continue;
+
+        if (n->what == kind::add) {
+            report(solver.try_add_constraint(n->c));
+        } else if (n->what == kind::remove) {
+            report(solver.try_remove_constraint(n->c));
+        } else {
+            // A variable that can't be held can't take a suggestion
+            // either.
+            status s = solver.try_hold_edit_var(n->v);
+            report(s);
+            if (s == status::ok) {
+                vars.push_back(n->v);
+                values.push_back(n->value);
+            }
+        }
+    }
+
+    if (!vars.empty()) {
+        report(solver.try_suggest_values(vars.data(), values.data(),
+                                         vars.size()));
+        solver.resolve();
+    }
+    return result;
+}
+
+} // namespace rhea
@@ -0,0 +1,95 @@
+//---------------------------------------------------------------------------
+/// \file   command_queue.hpp
+/// \brief  Queue changes to a solver from any number of threads
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#pragma once
+
+#include <atomic>
+
+#include "constraint.hpp"
+#include "errors.hpp"
+#include "simplex_solver.hpp"
+#include "variable.hpp"
+
+namespace rhea
+{
+
+/** A queue of changes in front of a simplex_solver.
+ * Any number of threads can add and remove constraints and suggest
+ * values at the same time; submitting never blocks and never waits for
+ * the solver.  The thread that owns the solver picks the changes up in
+ * batches by calling drain().
+ *
+ * Before a batch touches the tableau, it is cleaned up:
+ *  - If a constraint is added and then removed again, both are dropped.
+ *  - Only the last value suggested for a variable is used.
+ */
+class command_queue
+{
+public:
+    command_queue()
+        : head_{nullptr}
+    {
+    }
+
+    /** Drop everything that hasn't been drained yet. */
+    ~command_queue();
+
+    command_queue(const command_queue&) = delete;
+    command_queue& operator=(const command_queue&) = delete;
+
+    /** Queue a constraint to be added. */
+    void add_constraint(const constraint& c);
+
+    /** Queue a constraint to be removed. */
+    void remove_constraint(const constraint& c);
+
+    /** Queue a new value for a variable.
+     * When the batch is drained, the variable becomes a held edit
+     * variable of the solver if it isn't one yet. */
+    void suggest_value(const variable& v, double x);
+
+    /** Check if there is nothing to drain.
+     * Other threads can submit something right after this returns. */
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) == nullptr;
+    }
+
+    /** Apply everything that was submitted so far to a solver.
+     * Only one thread at a time can drain a queue.  Constraints are
+     * added and removed in the order they were submitted, after which
+     * the suggested values are applied and the solver is resolved once.
+     * A change that fails doesn't stop the rest of the batch.
+     * \return status::ok, or the status of the first change that failed
+     */
+    status drain(simplex_solver& solver);
+
+private:
+    enum class kind { add, remove, suggest };
+
+    struct node
+    {
+        kind what;
+        constraint c;
+        variable v;
+        double value;
+        node* next;
+    };
+
+    /** Deletes a node and all the ones after it. */
+    struct free_list
+    {
+        void operator()(node* n) const;
+    };
+
+    void push(node* n);
+
+private:
+    // The most recent submission first.
+    std::atomic<node*> head_;
+};
+
+} // namespace rhea
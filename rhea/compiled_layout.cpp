@@ -0,0 +1,251 @@
+//---------------------------------------------------------------------------
+// compiled_layout.cpp
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#include "compiled_layout.hpp"
+
+#include <sstream>
+
+#include "errors.hpp"
+
+namespace rhea
+{
+
+namespace
+{
+
+// How far a point may be outside a region, to allow for rounding errors.
+const double tolerance = 1.0e-8;
+
+// Remove the bounds that hold everywhere, and the duplicates.
+void prune(std::vector<double>& bounds, size_t width)
+{
+    std::vector<double> result;
+    for (size_t i = 0; i < bounds.size(); i += width) {
+        auto first = bounds.begin() + i;
+        auto last = first + width;
+        if (std::all_of(first + 1, last, [](double a) { return a == 0.0; })
+            && *first >= -tolerance)
+            continue;
+
+        bool duplicate = false;
+        for (size_t j = 0; j < result.size() && !duplicate; j += width)
+            duplicate = std::equal(first, last, result.begin() + j);
+
+        if (!duplicate)
+            result.insert(result.end(), first, last);
+    }
+    bounds.swap(result);
+}
+
+double evaluate_row(const double* row, const double* in, size_t n)
+{
+    double sum = row[0];
+    for (size_t k = 0; k < n; ++k)
+        sum += row[k + 1] * in[k];
+
+    return sum;
+}
+
+// Keeps the stay constants of a solver where they are while it is being
+// sampled, and switches parametric mode on.  The values suggested for the
+// edit variables and both flags are put back when it goes out of scope.
+class sampling_mode
+{
+public:
+    sampling_mode(simplex_solver& solver, const std::vector<variable>& edits)
+        : solver_(solver)
+        , edits_(edits)
+        , was_parametric_(solver.is_parametric())
+        , was_resetting_(solver.is_auto_reset_stay_constants())
+        , restored_(false)
+    {
+        for (auto& v : edits_)
+            start_.push_back(solver_.edit_value(v));
+
+        solver_.set_parametric(true);
+        solver_.set_auto_reset_stay_constants(false);
+    }
+
+    sampling_mode(const sampling_mode&) = delete;
+    sampling_mode& operator=(const sampling_mode&) = delete;
+
+    ~sampling_mode()
+    {
+        if (!restored_) {
+#if RHEA_HAS_EXCEPTIONS
+            // Already unwinding; the first exception is the one that
+            // gets reported.
+            try {
+                restore();
+            }
+            catch (...) {
+            }
+#else
+            restore();
+#endif
+        }
+        solver_.set_auto_reset_stay_constants(was_resetting_);
+        solver_.set_parametric(was_parametric_);
+    }
+
+    // Suggest the original values again.
+    void restore()
+    {
+        restored_ = true;
+        for (size_t k = 0; k < edits_.size(); ++k)
+            solver_.suggest_value(edits_[k], start_[k]);
+
+        solver_.resolve();
+    }
+
+private:
+    simplex_solver& solver_;
+    const std::vector<variable>& edits_;
+    std::vector<double> start_;
+    bool was_parametric_;
+    bool was_resetting_;
+    bool restored_;
+};
+
+void write_row(std::ostream& str, const double* row, size_t n)
+{
+    str << row[0];
+    for (size_t k = 0; k < n; ++k) {
+        if (row[k + 1] != 0.0)
+            str << " + " << row[k + 1] << " * in[" << k << "]";
+    }
+}
+
+} // anonymous namespace
+
+compiled_layout::compiled_layout(simplex_solver& solver,
+                                 std::vector<edit_range> inputs,
+                                 std::vector<variable> outputs,
+                                 size_t samples)
+    : inputs_(std::move(inputs))
+    , outputs_(std::move(outputs))
+{
+    std::vector<variable> edits;
+    for (auto& in : inputs_) {
+        if (!solver.has_edit_var(in.var))
+            RHEA_THROW(edit_misuse(in.var));
+
+        edits.push_back(in.var);
+    }
+
+    // Keep the stay constants where they are, so every sample point is
+    // solved for the same tableau.
+    sampling_mode mode(solver, edits);
+
+    size_t n = inputs_.size();
+    size_t width = n + 1;
+    size_t steps = std::max<size_t>(samples, 2);
+    std::vector<size_t> step(n, 0);
+    std::vector<double> point(n);
+    for (;;) {
+        for (size_t k = 0; k < n; ++k) {
+            const edit_range& in = inputs_[k];
+            point[k] = in.min + (in.max - in.min) * step[k] / (steps - 1);
+        }
+
+        // Only points that are not covered yet need a new basis.
+        if (find(point.data()) < 0) {
+            for (size_t k = 0; k < n; ++k)
+                solver.suggest_value(edits[k], point[k]);
+
+            solver.resolve();
+            simplex_solver::affine_region region;
+            if (solver.parametric_region(edits, outputs_, region)) {
+                prune(region.bounds, width);
+                regions_.push_back(std::move(region));
+            }
+        }
+
+        size_t k = 0;
+        while (k < n && ++step[k] == steps)
+            step[k++] = 0;
+
+        if (k == n)
+            break;
+    }
+
+    mode.restore();
+}
+
+int compiled_layout::find(const double* in) const
+{
+    size_t n = inputs_.size();
+    for (size_t r = 0; r < regions_.size(); ++r) {
+        char inside = 1;
+        double scratch;
+        regions_[r].clip(in, n, 1, &inside, &scratch, tolerance);
+        if (inside)
+            return static_cast<int>(r);
+    }
+    return -1;
+}
+
+int compiled_layout::evaluate(const double* in, double* out) const
+{
+    int r = find(in);
+    if (r < 0)
+        return r;
+
+    size_t n = inputs_.size();
+    const auto& values = regions_[r].values;
+    for (size_t j = 0; j < outputs_.size(); ++j)
+        out[j] = evaluate_row(&values[j * (n + 1)], in, n);
+
+    return r;
+}
+
+std::string compiled_layout::to_cpp(const std::string& name) const
+{
+    size_t n = inputs_.size();
+    size_t width = n + 1;
+    std::ostringstream str;
+    str.precision(17);
+    str << "// Generated by rhea::compiled_layout, " << regions_.size()
+        << " regions.\n"
+        << "inline int " << name << "(const double* in, double* out)\n"
+        << "{\n";
+
+    bool everywhere = false;
+    for (size_t r = 0; r < regions_.size(); ++r) {
+        const auto& region = regions_[r];
+        const char* indent = "    ";
+        if (!region.bounds.empty()) {
+            str << "    if (";
+            for (size_t i = 0; i < region.bounds.size(); i += width) {
+                if (i > 0)
+                    str << "\n        && ";
+                write_row(str, &region.bounds[i], n);
+                str << " >= " << -tolerance;
+            }
+            str << ") {\n";
+            indent = "        ";
+        }
+        for (size_t j = 0; j < outputs_.size(); ++j) {
+            str << indent << "out[" << j << "] = ";
+            write_row(str, &region.values[j * width], n);
+            str << ";\n";
+        }
+        str << indent << "return " << r << ";\n";
+        if (region.bounds.empty()) {
+            everywhere = true;
+            break;
+        }
+
+        str << "    }\n";
+    }
+
+    if (!everywhere)
+        str << "    return -1;\n";
+
+    str << "}\n";
+    return str.str();
+}
+
+} // namespace rhea
@@ -0,0 +1,87 @@
+//---------------------------------------------------------------------------
+/// \file   compiled_layout.hpp
+/// \brief  A solver compiled to a piecewise-affine function
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "simplex_solver.hpp"
+
+namespace rhea
+{
+
+/** An edit variable, and the range of values it is expected to take. */
+struct edit_range
+{
+    variable var;
+    double min;
+    double max;
+};
+
+/** The solutions of a solver, as a function of a few edit variables.
+ * A lot of layouts have a fixed set of constraints, and only a couple of
+ * edit variables, such as the size of a window.  The solution is then a
+ * piecewise-affine function of the edit values: every basis of the
+ * tableau covers a convex region, and is affine inside it.  This class
+ * enumerates these regions over a grid of sample points, and evaluates
+ * them without a tableau.  It can also write them out as a C++ function
+ * that can be compiled into the application.
+ *
+ * The function is the solution of the tableau as it was when the layout
+ * was compiled, with the stay constants kept where they were. */
+class compiled_layout
+{
+public:
+    /** Compile a solver.
+     * All the inputs have to be edit variables of \a solver.  The solver
+     * is left in the same state as it was found: the values suggested
+     * for the inputs are suggested again, and the parametric and
+     * auto-reset flags are restored, also if an exception is thrown.
+     * \param solver   The solver to compile
+     * \param inputs   The edit variables, and the range to sample
+     * \param outputs  The variables to calculate
+     * \param samples  The number of sample points per edit variable.  A
+     *                 region that falls between two sample points can be
+     *                 missed. */
+    compiled_layout(simplex_solver& solver, std::vector<edit_range> inputs,
+                    std::vector<variable> outputs, size_t samples = 16);
+
+    /** Calculate the outputs.
+     * \param in   The values of the edit variables, in the same order as
+     *             they were passed to the constructor
+     * \param out  Receives the values of the outputs
+     * \return The region that was used, or -1 if the inputs are not in
+     *         any of the regions; \a out is not touched in that case */
+    int evaluate(const double* in, double* out) const;
+
+    /** Find the region that covers a point.
+     * \return The index of the region, or -1 if there is none */
+    int find(const double* in) const;
+
+    const std::vector<simplex_solver::affine_region>& regions() const
+    {
+        return regions_;
+    }
+
+    const std::vector<edit_range>& inputs() const { return inputs_; }
+
+    const std::vector<variable>& outputs() const { return outputs_; }
+
+    /** Write the layout as a C++ function.
+     * The function has the signature
+     * <tt>inline int name(const double* in, double* out)</tt>, and
+     * behaves the same as evaluate().
+     * \param name  The name of the function */
+    std::string to_cpp(const std::string& name) const;
+
+private:
+    std::vector<edit_range> inputs_;
+    std::vector<variable> outputs_;
+    std::vector<simplex_solver::affine_region> regions_;
+};
+
+} // namespace rhea
@@ -0,0 +1,68 @@
+//---------------------------------------------------------------------------
+// constraint_model.cpp
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#include "constraint_model.hpp"
+
+#include <unordered_set>
+
+#include "errors.hpp"
+
+namespace rhea
+{
+
+constraint_model::constraint_model(const simplex_solver& prototype,
+                                   std::vector<variable> parameters)
+    : prototype_(prototype)
+    , parameters_(std::move(parameters))
+{
+    if (prototype_.has_edit_vars())
+        RHEA_THROW(edit_misuse());
+
+    prototype_.on_resolve = nullptr;
+    prototype_.on_variable_change = nullptr;
+    prototype_.solve();
+
+    // The instances share the constraints of the prototype, so none of
+    // them may change their strength or weight.
+    auto frozen = std::make_shared<std::unordered_set<constraint>>();
+    if (prototype_.frozen_)
+        *frozen = *prototype_.frozen_;
+    for (auto& m : prototype_.marker_vars_)
+        frozen->insert(m.first);
+    for (auto& s : prototype_.shared_rows_)
+        frozen->insert(s.first);
+    for (auto& i : prototype_.implied_)
+        frozen->insert(i.first);
+    prototype_.frozen_ = std::move(frozen);
+}
+
+void constraint_model::instantiate(simplex_solver& instance,
+                                   const std::vector<variable>& vars) const
+{
+    if (vars.size() != parameters_.size())
+        RHEA_THROW(edit_misuse());
+
+    // Two parameters can't be merged into one variable, and a variable
+    // that is already in the tableau would get two columns.  The
+    // parameters themselves can be used for one instance.
+    std::unordered_set<variable> seen;
+    for (size_t i = 0; i < vars.size(); ++i) {
+        if (!seen.insert(vars[i]).second)
+            RHEA_THROW(edit_misuse(vars[i]));
+
+        if (!vars[i].is(parameters_[i])
+            && prototype_.contains_variable(vars[i]))
+            RHEA_THROW(edit_misuse(vars[i]));
+    }
+
+    auto on_resolve = std::move(instance.on_resolve);
+    auto on_variable_change = std::move(instance.on_variable_change);
+    instance = prototype_;
+    instance.on_resolve = std::move(on_resolve);
+    instance.on_variable_change = std::move(on_variable_change);
+    instance.replace_variables(parameters_, vars);
+}
+
+} // namespace rhea
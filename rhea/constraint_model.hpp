@@ -0,0 +1,65 @@
+//---------------------------------------------------------------------------
+/// \file   constraint_model.hpp
+/// \brief  A set of constraints that is solved once, and used many times
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#pragma once
+
+#include <vector>
+
+#include "simplex_solver.hpp"
+
+namespace rhea
+{
+
+/** A set of constraints that is solved once, and instantiated for many
+ ** sets of variables.
+ * Adding constraints to a solver is the expensive part: every
+ * constraint is turned into an expression, and the tableau is pivoted
+ * to make room for it.  If a lot of solvers start out with the same
+ * constraints, for instance for documents that share a template, this
+ * can be done once in a prototype.  Every instance then gets a copy of
+ * the solved tableau, with the parameters of the model replaced by its
+ * own variables.  The instances are ordinary solvers: constraints, stays
+ * and edit variables can be added to them as usual, and the constraints
+ * of the model can be removed through the handles they were added
+ * with.
+ *
+ * Those handles are shared by the prototype and all its instances, so
+ * the constraints of the model are immutable: changing their strength
+ * or weight in an instance throws shared_constraint, and they must not
+ * be changed in the solver the prototype was copied from either. */
+class constraint_model
+{
+public:
+    /** Create a model.
+     * \param prototype   A solver with the constraints of the model, and
+     *                    no edit variables
+     * \param parameters  The variables of \a prototype that every
+     *                    instance replaces with its own */
+    constraint_model(const simplex_solver& prototype,
+                     std::vector<variable> parameters);
+
+    const std::vector<variable>& parameters() const { return parameters_; }
+
+    /** Turn a solver into an instance of this model.
+     * Whatever was in \a instance is discarded, except for its
+     * callbacks.  Several threads can instantiate the same model at once,
+     * as long as each of them uses its own instance.
+     * \param instance  The solver to overwrite
+     * \param vars      The variables that replace the parameters, in the
+     *                  same order
+     * \throws edit_misuse if \a vars and parameters() differ in size,
+     *         if a variable appears twice in \a vars, or if it is
+     *         already in the prototype other than as the parameter it
+     *         replaces */
+    void instantiate(simplex_solver& instance,
+                     const std::vector<variable>& vars) const;
+
+private:
+    simplex_solver prototype_;
+    std::vector<variable> parameters_;
+};
+
+} // namespace rhea
@@ -0,0 +1,53 @@
+//---------------------------------------------------------------------------
+/// \file   copy_on_write.hpp
+/// \brief  A value that is shared between copies until it is changed
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#pragma once
+
+#include <memory>
+
+namespace rhea
+{
+
+/** A value that is shared between copies until one of them changes it.
+ * Copying a cow_ptr only copies a reference.  Read access goes to the
+ * shared value; write() makes a private copy first if anyone else still
+ * refers to it.  Note that a reference returned by write() is only
+ * private until the cow_ptr is copied again. */
+template <typename T>
+class cow_ptr
+{
+public:
+    cow_ptr()
+        : p_{std::make_shared<T>()}
+    {
+    }
+
+    cow_ptr(T value)
+        : p_{std::make_shared<T>(std::move(value))}
+    {
+    }
+
+    const T& operator*() const { return *p_; }
+
+    const T* operator->() const { return p_.get(); }
+
+    /** Get write access to the value. */
+    T& write()
+    {
+        if (p_.use_count() > 1)
+            p_ = std::make_shared<T>(*p_);
+
+        return *p_;
+    }
+
+    /** Check if this is the only reference to the value. */
+    bool is_unique() const { return p_.use_count() == 1; }
+
+private:
+    std::shared_ptr<T> p_;
+};
+
+} // namespace rhea
@@ -6,14 +6,41 @@
 //---------------------------------------------------------------------------
 #pragma once
 
+#include <cstdlib>
 #include <string>
 #include <stdexcept>
 
+// The library can be built with exceptions disabled.  The non-throwing
+// functions of the solver (simplex_solver::try_add_constraint() and
+// friends) report errors with a status code instead; any other error is
+// fatal in that case.
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)                         \
+    || defined(_CPPUNWIND)
+#define RHEA_HAS_EXCEPTIONS 1
+#define RHEA_THROW(e) throw e
+#else
+#define RHEA_HAS_EXCEPTIONS 0
+#define RHEA_THROW(e) std::abort()
+#endif
+
 namespace rhea
 {
 
 class variable;
 
+/** Result of the non-throwing solver functions.
+ * Every value except \c ok and \c partial corresponds to the exception
+ * class of the same name. \sa simplex_solver::try_add_constraint() */
+enum class status {
+    ok,
+    required_failure,
+    edit_misuse,
+    constraint_not_found,
+    /** The work ran out of budget, and can be continued later.
+     ** \sa simplex_solver::resolve_for() */
+    partial
+};
+
 /** Base class for all Rhea exceptions. */
 class error : public std::exception
 {
@@ -160,6 +187,33 @@ public:
     }
 };
 
+/** simplex_solver::commit() or simplex_solver::rollback() was called
+ ** without a matching simplex_solver::begin_transaction(). */
+class transaction_misuse : public error
+{
+public:
+    virtual ~transaction_misuse() throw() {}
+
+    virtual const char* what() const throw()
+    {
+        return "no transaction has been started";
+    }
+};
+
+/** The application tried to change the strength or weight of a
+ ** constraint that it shares with other solvers.
+ * \sa constraint_model */
+class shared_constraint : public error
+{
+public:
+    virtual ~shared_constraint() throw() {}
+
+    virtual const char* what() const throw()
+    {
+        return "the constraint is shared with other solvers";
+    }
+};
+
 /** The application tried to remove a row that doesn't exist. */
 class row_not_found : public error
 {
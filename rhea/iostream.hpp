@@ -72,7 +72,7 @@ inline ostream& operator<<(ostream& str, const rhea::tableau& v)
     str << "Tableau columns" << std::endl;
     for (auto& col : v.columns()) {
         str << "  " << col.first << " : ";
-        for (auto& var : col.second)
+        for (auto& var : *col.second)
             str << var << "  ";
 
         str << std::endl;
@@ -80,7 +80,7 @@ inline ostream& operator<<(ostream& str, const rhea::tableau& v)
 
     str << "Tableau rows" << std::endl;
     for (auto& row : v.rows())
-        str << "  " << row.first << " : " << row.second << std::endl;
+        str << "  " << row.first << " : " << *row.second << std::endl;
 
     return str;
 }
@@ -50,7 +50,7 @@ linear_expression& linear_expression::operator*=(const linear_expression& x)
         return *this = x * constant();
 
     if (!x.is_constant())
-        throw nonlinear_expression();
+        RHEA_THROW(nonlinear_expression());
 
     return operator*=(x.constant());
 }
@@ -58,7 +58,7 @@ linear_expression& linear_expression::operator*=(const linear_expression& x)
 linear_expression& linear_expression::operator/=(const linear_expression& x)
 {
     if (!x.is_constant())
-        throw nonlinear_expression();
+        RHEA_THROW(nonlinear_expression());
 
     return operator/=(x.constant());
 }
@@ -175,14 +175,15 @@ void linear_expression::change_subject(const variable& old_subj,
     terms_[old_subj] = tmp;
 }
 
-void linear_expression::substitute_out(const variable& var,
-                                       const linear_expression& expr,
-                                       const variable& subj, tableau& solver)
+template <typename F>
+void linear_expression::substitute_out_(const variable& var,
+                                        const linear_expression& expr,
+                                        F note)
 {
     auto it = terms_.find(var);
     if (it == terms_.end()) {
-        throw std::runtime_error(
-            "substitute variable is not part of the expression");
+        RHEA_THROW(std::runtime_error(
+            "substitute variable is not part of the expression"));
     }
     double multiplier = it->second;
     terms_.erase(it);
@@ -198,14 +199,35 @@ void linear_expression::substitute_out(const variable& var,
         auto oc = terms_.find(v);
         if (oc != terms_.end()) {
             if (near_zero(oc->second += mc)) {
-                solver.note_removed_variable(oc->first, subj);
+                note(oc->first, false);
                 terms_.erase(oc);
             }
         } else {
             terms_[v] = mc;
-            solver.note_added_variable(v, subj);
+            note(v, true);
         }
     }
 }
 
+void linear_expression::substitute_out(const variable& var,
+                                       const linear_expression& expr,
+                                       const variable& subj, tableau& solver)
+{
+    substitute_out_(var, expr, [&](const variable& v, bool added) {
+        if (added)
+            solver.note_added_variable(v, subj);
+        else
+            solver.note_removed_variable(v, subj);
+    });
+}
+
+void linear_expression::substitute_out(const variable& var,
+                                       const linear_expression& expr,
+                                       std::vector<change>& changes)
+{
+    substitute_out_(var, expr, [&](const variable& v, bool added) {
+        changes.emplace_back(v, added);
+    });
+}
+
 } // namespace rhea
@@ -6,6 +6,9 @@
 //---------------------------------------------------------------------------
 #pragma once
 
+#include <utility>
+#include <vector>
+
 #include "flat_map.hpp"
 #include "approx.hpp"
 #include "variable.hpp"
@@ -126,6 +129,22 @@ public:
     void substitute_out(const variable& v, const linear_expression& expr,
                         const variable& subj, tableau& solver);
 
+    /** A variable that substitute_out() added to an expression (true),
+     ** or dropped from it (false). */
+    typedef std::pair<variable, bool> change;
+
+    /** Replace \a var with a symbolic expression that is equal to it,
+     ** without telling a tableau.
+     * The changes that the tableau needs to know about are appended to
+     * \a changes instead, in the order in which they happened.  This
+     * way several rows can be changed at the same time.
+     * \param v        The variable to be replaced
+     * \param expr     The expression to replace it with
+     * \param changes  Receives the variables that were added or
+     *                 dropped */
+    void substitute_out(const variable& v, const linear_expression& expr,
+                        std::vector<change>& changes);
+
     /** This linear expression currently represents the equation
      ** oldSubject=self, destructively modify it so that it represents
      ** the equation NewSubject=self.
@@ -183,6 +202,11 @@ public:
     /** Returns true iff this expression is constant. */
     bool is_constant() const { return terms_.empty(); }
 
+private:
+    template <typename F>
+    void substitute_out_(const variable& v, const linear_expression& expr,
+                         F note);
+
 private:
     /** The expression's constant term. */
     double constant_;
@@ -43,7 +43,7 @@ public:
             break;
 
         default:
-            throw edit_misuse(); // LCOV_EXCL_LINE
+            RHEA_THROW(edit_misuse()); // LCOV_EXCL_LINE
         };
     }
 
@@ -63,7 +63,7 @@ public:
             break;
 
         default:
-            throw edit_misuse(); // LCOV_EXCL_LINE
+            RHEA_THROW(edit_misuse()); // LCOV_EXCL_LINE
         };
     }
 
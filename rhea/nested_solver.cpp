@@ -0,0 +1,155 @@
+//---------------------------------------------------------------------------
+// nested_solver.cpp
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#include "nested_solver.hpp"
+
+#include <limits>
+
+namespace rhea
+{
+
+nested_solver::nested_solver()
+    : parent_{nullptr}
+    , needs_solving_{false}
+    , changed_{false}
+    , pending_{false}
+{
+    solver_.set_autosolve(false);
+}
+
+nested_solver& nested_solver::add_child()
+{
+    children_.emplace_back(new nested_solver);
+    children_.back()->parent_ = this;
+    return *children_.back();
+}
+
+nested_solver& nested_solver::export_variable(const variable& inner,
+                                              const variable& outer)
+{
+    const double none = std::numeric_limits<double>::quiet_NaN();
+    boundary_.push_back({inner, outer, none, none});
+    solver_.hold_edit_var(inner, strength::strong());
+    if (parent_)
+        parent_->solver_.hold_edit_var(outer, strength::medium());
+
+    needs_solving_ = true;
+    touch();
+    if (root().auto_solve_)
+        solve();
+
+    return *this;
+}
+
+nested_solver& nested_solver::suggest(const variable& v, double x)
+{
+    solver_.suggest(v, x);
+    changed_ = true;
+    touch();
+    if (root().auto_solve_)
+        solve();
+
+    return *this;
+}
+
+solver& nested_solver::add_constraint_(const constraint& c)
+{
+    solver_.add_constraint(c);
+    needs_solving_ = true;
+    touch();
+    if (root().auto_solve_)
+        solve();
+
+    return *this;
+}
+
+solver& nested_solver::remove_constraint_(const constraint& c)
+{
+    solver_.remove_constraint(c);
+    needs_solving_ = true;
+    touch();
+    if (root().auto_solve_)
+        solve();
+
+    return *this;
+}
+
+nested_solver& nested_solver::solve()
+{
+    nested_solver& top = root();
+    if (top.pending_) {
+        top.solve_up();
+        top.solve_down();
+    }
+    return *this;
+}
+
+nested_solver& nested_solver::root()
+{
+    nested_solver* n = this;
+    while (n->parent_)
+        n = n->parent_;
+
+    return *n;
+}
+
+void nested_solver::touch()
+{
+    for (nested_solver* n = this; n && !n->pending_; n = n->parent_)
+        n->pending_ = true;
+}
+
+void nested_solver::solve_up()
+{
+    for (auto& child : children_) {
+        if (child->pending_)
+            child->solve_up();
+    }
+
+    if (needs_solving_) {
+        solver_.solve();
+        needs_solving_ = false;
+        changed_ = true;
+    }
+    if (!changed_ || !parent_)
+        return;
+
+    for (auto& b : boundary_) {
+        double x = b.inner.value();
+        if (x != b.up) {
+            b.up = x;
+            parent_->solver_.suggest(b.outer, x);
+            parent_->changed_ = true;
+        }
+    }
+}
+
+void nested_solver::solve_down()
+{
+    for (auto& child : children_) {
+        if (changed_) {
+            for (auto& b : child->boundary_) {
+                double x = b.outer.value();
+                if (x != b.down) {
+                    b.down = x;
+                    child->solver_.suggest(b.inner, x);
+                    child->changed_ = true;
+                }
+            }
+        }
+        if (child->changed_ || child->pending_) {
+            // Whatever the child ends up with now has been seen by the
+            // parent, there is no need to suggest it back up.
+            for (auto& b : child->boundary_)
+                b.up = b.inner.value();
+
+            child->solve_down();
+        }
+    }
+    changed_ = false;
+    pending_ = false;
+}
+
+} // namespace rhea
@@ -0,0 +1,119 @@
+//---------------------------------------------------------------------------
+/// \file   nested_solver.hpp
+/// \brief  A tree of solvers, linked through boundary variables
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "simplex_solver.hpp"
+
+namespace rhea
+{
+
+/** A tree of solvers, one for every container of a user interface.
+ * Every container has a simplex_solver of its own, with the constraints
+ * of its contents.  A few of its variables, usually the edges and the
+ * size of the container, are exported to the parent as boundary
+ * variables.  Each of these is a pair: the inner variable is used in the
+ * constraints of the container, the outer one in those of the parent.
+ *
+ * The parent has the final say: the inner variable follows the outer
+ * one with a strong edit constraint.  The other way around, the value
+ * the container would like to have is suggested to the parent with a
+ * medium edit constraint.  Solving the tree first goes up from the
+ * containers that changed, as far as their boundary values change, and
+ * then goes back down into the containers whose boundary values were
+ * changed by their parents.  The rest of the tree is not touched.
+ *
+ * Since every container only sees its own variables, the tableaus stay
+ * small, and pivoting in one container does not fill in the rows of
+ * another.  The price is that the parent only sees what its containers
+ * would like to have, not their required constraints.  If these can't
+ * be met, a container and its parent can disagree on a boundary value.
+ *
+ * Only the autosolve setting of the root is used, for the whole tree. */
+class nested_solver : public solver
+{
+public:
+    nested_solver();
+
+    virtual ~nested_solver() {}
+
+    nested_solver(const nested_solver&) = delete;
+    nested_solver& operator=(const nested_solver&) = delete;
+
+    /** Add a container to this one. */
+    nested_solver& add_child();
+
+    nested_solver* parent() const { return parent_; }
+
+    const std::vector<std::unique_ptr<nested_solver>>& children() const
+    {
+        return children_;
+    }
+
+    /** Link a variable of this container to one of its parent.
+     * \param inner  The variable in the constraints of this container
+     * \param outer  The variable in the constraints of the parent */
+    nested_solver& export_variable(const variable& inner,
+                                   const variable& outer);
+
+    /** Suggest a new value for a variable of this container.
+     * \sa simplex_solver::suggest() */
+    nested_solver& suggest(const variable& v, double x);
+
+    /** Bring the whole tree up to date, no matter which container this is
+     ** called on. */
+    nested_solver& solve();
+
+    void resolve() { solve(); }
+
+    /** The solver with the constraints of this container. */
+    const simplex_solver& container() const { return solver_; }
+
+protected:
+    solver& add_constraint_(const constraint& c);
+    solver& remove_constraint_(const constraint& c);
+
+private:
+    struct boundary
+    {
+        variable inner;
+        variable outer;
+        // The values that were last suggested to either side.
+        double up;
+        double down;
+    };
+
+    nested_solver& root();
+
+    // Note that something in this container has changed.
+    void touch();
+
+    // Solve the containers below this one that have changed, and pass
+    // their boundary values on to their parents.
+    void solve_up();
+
+    // Pass the boundary values on to the children.
+    void solve_down();
+
+private:
+    simplex_solver solver_;
+    nested_solver* parent_;
+    std::vector<std::unique_ptr<nested_solver>> children_;
+    std::vector<boundary> boundary_;
+
+    // Constraints were added or removed since the last solve.
+    bool needs_solving_;
+    // The values of some of the variables have changed, and the
+    // children have to be checked.
+    bool changed_;
+    // This container or one of its descendants has changed.
+    bool pending_;
+};
+
+} // namespace rhea
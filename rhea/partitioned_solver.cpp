@@ -0,0 +1,386 @@
+//---------------------------------------------------------------------------
+// partitioned_solver.cpp
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#include "partitioned_solver.hpp"
+
+#include <algorithm>
+
+#include "errors.hpp"
+
+namespace rhea
+{
+
+partitioned_solver::partitioned_solver(size_t threads)
+    : lazy_{false}
+{
+    if (threads > 1)
+        pool_.reset(new thread_pool(threads));
+}
+
+solver& partitioned_solver::add_constraint_(const constraint& c)
+{
+    // The constraint is already in one of the components.
+    if (constraints_.count(c) > 0)
+        return *this;
+
+    // Find all the components the constraint touches.  It goes into the
+    // biggest one, the others are merged into it.  A component that is
+    // being edited can't be merged, so that one has to be the biggest.
+    auto expr = c.expression();
+    std::vector<component_info*> touched;
+    for (auto& term : expr.terms()) {
+        auto i = owner_.find(term.first);
+        if (i != owner_.end()
+            && std::find(touched.begin(), touched.end(), i->second)
+                   == touched.end())
+            touched.push_back(i->second);
+    }
+
+    component_info* target = nullptr;
+    for (auto comp : touched) {
+        if (!target
+            || comp->constraints.size() > target->constraints.size())
+            target = comp;
+    }
+    for (auto comp : touched) {
+        if (comp->solv.has_edit_vars()) {
+            if (target->solv.has_edit_vars() && comp != target)
+                RHEA_THROW(edit_misuse());
+
+            target = comp;
+        }
+    }
+    for (auto comp : touched) {
+        if (comp != target)
+            merge(*comp, *target);
+    }
+    if (!target)
+        target = new_component();
+
+    target->solv.add_constraint(c);
+    target->constraints.push_back(c);
+    constraints_.emplace(
+        c, std::make_pair(target, std::prev(target->constraints.end())));
+
+    for (auto& term : expr.terms()) {
+        target->vars.insert(term.first);
+        owner_[term.first] = target;
+    }
+    target->needs_solving = true;
+
+    if (auto_solve_)
+        solve();
+
+    return *this;
+}
+
+solver& partitioned_solver::remove_constraint_(const constraint& c)
+{
+    auto found = constraints_.find(c);
+    if (found == constraints_.end())
+        RHEA_THROW(constraint_not_found());
+
+    component_info& comp = *found->second.first;
+    comp.solv.remove_constraint(c);
+    comp.constraints.erase(found->second.second);
+    constraints_.erase(found);
+    comp.needs_solving = true;
+    comp.may_split = true;
+
+    if (auto_solve_)
+        solve();
+
+    return *this;
+}
+
+partitioned_solver& partitioned_solver::begin_edit()
+{
+    bool editing = false;
+    for (auto& comp : components_) {
+        if (comp->solv.has_edit_vars()) {
+            comp->solv.begin_edit();
+            editing = true;
+        }
+    }
+    if (!editing)
+        RHEA_THROW(edit_misuse());
+
+    return *this;
+}
+
+partitioned_solver& partitioned_solver::end_edit()
+{
+    std::vector<component_info*> editing;
+    for (auto& comp : components_) {
+        if (comp->solv.has_edit_vars())
+            editing.push_back(comp.get());
+    }
+    if (editing.empty())
+        RHEA_THROW(edit_misuse());
+
+    resolve();
+    for (auto comp : editing) {
+        comp->solv.end_edit();
+
+        // Forget the edit constraints that end_edit() has removed.
+        auto i = comp->constraints.begin();
+        while (i != comp->constraints.end()) {
+            if (i->is_edit_constraint()
+                && !comp->solv.contains_constraint(*i)) {
+                constraints_.erase(*i);
+                i = comp->constraints.erase(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+    return *this;
+}
+
+partitioned_solver& partitioned_solver::suggest_value(const variable& v,
+                                                      double x)
+{
+    auto found = owner_.find(v);
+    if (found == owner_.end())
+        RHEA_THROW(edit_misuse(v));
+
+    component_info& comp = *found->second;
+    comp.solv.suggest_value(v, x);
+    comp.needs_resolving = true;
+    return *this;
+}
+
+void partitioned_solver::resolve()
+{
+    if (lazy_)
+        return;
+
+    std::vector<component_info*> dirty;
+    for (auto& comp : components_) {
+        if (comp->needs_resolving) {
+            dirty.push_back(comp.get());
+            comp->needs_resolving = false;
+        }
+    }
+    run(dirty, [](simplex_solver& s) { s.resolve(); });
+}
+
+partitioned_solver& partitioned_solver::solve()
+{
+    if (lazy_)
+        return *this;
+
+    // split() appends the new components, which don't need to be checked
+    // again.
+    for (size_t i = 0, n = components_.size(); i < n; ++i) {
+        auto& comp = *components_[i];
+        if (comp.may_split && !comp.solv.has_edit_vars())
+            split(comp);
+    }
+    remove_empty_components();
+
+    std::vector<component_info*> dirty;
+    for (auto& comp : components_) {
+        if (comp->needs_solving) {
+            dirty.push_back(comp.get());
+            comp->needs_solving = false;
+        }
+    }
+    run(dirty, [](simplex_solver& s) { s.solve(); });
+    return *this;
+}
+
+partitioned_solver& partitioned_solver::set_lazy(bool on)
+{
+    lazy_ = on;
+    if (!lazy_) {
+        resolve();
+        solve();
+    }
+    return *this;
+}
+
+double partitioned_solver::value(const variable& v)
+{
+    auto found = owner_.find(v);
+    if (found == owner_.end())
+        return v.value();
+
+    component_info* comp = found->second;
+    if (comp->may_split && !comp->solv.has_edit_vars()) {
+        split(*comp);
+        found = owner_.find(v);
+        if (found == owner_.end())
+            return v.value();
+
+        comp = found->second;
+    }
+    update(*comp);
+    return v.value();
+}
+
+bool partitioned_solver::is_dirty(const variable& v) const
+{
+    auto found = owner_.find(v);
+    if (found == owner_.end())
+        return false;
+
+    auto& comp = *found->second;
+    return comp.needs_solving || comp.needs_resolving;
+}
+
+const simplex_solver* partitioned_solver::component(const variable& v) const
+{
+    auto found = owner_.find(v);
+    return found == owner_.end() ? nullptr : &found->second->solv;
+}
+
+partitioned_solver::component_info* partitioned_solver::new_component()
+{
+    components_.emplace_back(new component_info);
+    return components_.back().get();
+}
+
+void partitioned_solver::update(component_info& comp)
+{
+    // Suggested values can leave rows infeasible, the dual simplex has to
+    // run before the objective is optimized.
+    if (comp.needs_resolving) {
+        comp.solv.resolve();
+        comp.needs_resolving = false;
+    }
+    if (comp.needs_solving) {
+        comp.solv.solve();
+        comp.needs_solving = false;
+    }
+}
+
+void partitioned_solver::merge(component_info& from, component_info& into)
+{
+    for (auto& c : from.constraints) {
+        into.solv.add_constraint(c);
+        constraints_[c].first = &into;
+    }
+    into.constraints.splice(into.constraints.end(), from.constraints);
+
+    for (auto& v : from.vars) {
+        into.vars.insert(v);
+        owner_[v] = &into;
+    }
+    into.needs_solving = true;
+    into.may_split = into.may_split || from.may_split;
+
+    components_.erase(std::find_if(
+        components_.begin(), components_.end(),
+        [&](const component_ptr& p) { return p.get() == &from; }));
+}
+
+void partitioned_solver::split(component_info& comp)
+{
+    comp.may_split = false;
+
+    // Union-find over the variables of the remaining constraints.
+    std::unordered_map<variable, size_t> index;
+    std::vector<size_t> parent;
+    auto root = [&](size_t i) {
+        while (parent[i] != i)
+            i = parent[i] = parent[parent[i]];
+        return i;
+    };
+    auto find = [&](const variable& v) {
+        auto ins = index.emplace(v, parent.size());
+        if (ins.second)
+            parent.push_back(parent.size());
+
+        return root(ins.first->second);
+    };
+
+    for (auto& c : comp.constraints) {
+        auto expr = c.expression();
+        auto i = expr.terms().begin();
+        if (i == expr.terms().end())
+            continue;
+
+        size_t first = find(i->first);
+        for (++i; i != expr.terms().end(); ++i) {
+            size_t other = find(i->first);
+            if (other != first)
+                parent[other] = first;
+        }
+    }
+
+    // Number the groups in the order they first appear.  Constraints
+    // without any variables stay where they are.
+    std::unordered_map<size_t, component_info*> groups;
+    for (auto i = comp.constraints.begin(); i != comp.constraints.end();) {
+        auto next = std::next(i);
+        auto expr = i->expression();
+        if (!expr.terms().empty()) {
+            size_t r = root(index[expr.terms().begin()->first]);
+            auto ins = groups.emplace(r, nullptr);
+            if (ins.second && groups.size() > 1)
+                ins.first->second = new_component();
+
+            component_info* into = ins.first->second;
+            if (into) {
+                comp.solv.remove_constraint(*i);
+                into->solv.add_constraint(*i);
+                into->needs_solving = true;
+                constraints_[*i].first = into;
+                into->constraints.splice(into->constraints.end(),
+                                         comp.constraints, i);
+            }
+        }
+        i = next;
+    }
+
+    // Variables that are not in any constraint anymore are forgotten.
+    for (auto& v : comp.vars)
+        owner_.erase(v);
+
+    comp.vars.clear();
+    for (auto& g : groups) {
+        component_info* into = g.second ? g.second : &comp;
+        for (auto& c : into->constraints) {
+            auto expr = c.expression();
+            for (auto& term : expr.terms()) {
+                into->vars.insert(term.first);
+                owner_[term.first] = into;
+            }
+        }
+    }
+}
+
+void partitioned_solver::remove_empty_components()
+{
+    components_.erase(
+        std::remove_if(components_.begin(), components_.end(),
+                       [&](const component_ptr& p) {
+                           if (!p->constraints.empty())
+                               return false;
+
+                           for (auto& v : p->vars) {
+                               auto i = owner_.find(v);
+                               if (i != owner_.end() && i->second == p.get())
+                                   owner_.erase(i);
+                           }
+
+                           return true;
+                       }),
+        components_.end());
+}
+
+void partitioned_solver::run(
+    const std::vector<component_info*>& comps,
+    const std::function<void(simplex_solver&)>& action)
+{
+    if (pool_ && comps.size() > 1)
+        pool_->run(comps.size(), [&](size_t i) { action(comps[i]->solv); });
+    else
+        for (auto comp : comps)
+            action(comp->solv);
+}
+
+} // namespace rhea
@@ -0,0 +1,161 @@
+//---------------------------------------------------------------------------
+/// \file   partitioned_solver.hpp
+/// \brief  A solver that keeps independent constraints in separate tableaus
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "simplex_solver.hpp"
+#include "thread_pool.hpp"
+
+namespace rhea
+{
+
+/** A solver that keeps independent groups of constraints apart.
+ * Two constraints belong to the same component if they share a
+ * variable, directly or through other constraints.  A window full of
+ * dialogs and panels usually has a lot of components that have nothing
+ * to do with each other.  In a single simplex_solver, every edit still
+ * optimizes and updates the whole tableau.  This class gives every
+ * component a simplex_solver of its own instead, so only the components
+ * that changed are solved again, and they can be solved in parallel.
+ *
+ * Components are merged when a constraint is added that connects them;
+ * adding a constraint that is already in the solver does nothing.
+ * Removing a constraint can split a component, but this is only checked
+ * for on the next call to solve().  Every component is solved by the
+ * same steps, whether it is done in parallel or not, so the results do
+ * not depend on the number of threads. */
+class partitioned_solver : public solver
+{
+public:
+    /** \param threads  The number of components that can be solved at
+     *                  the same time.  With 0 or 1, everything is done in
+     *                  the calling thread. */
+    explicit partitioned_solver(size_t threads = 0);
+
+    virtual ~partitioned_solver() {}
+
+    /** Add an edit constraint for a given variable.
+     * \sa simplex_solver::add_edit_var() */
+    partitioned_solver& add_edit_var(const variable& v,
+                                     const strength& s = strength::strong(),
+                                     double weight = 1.0)
+    {
+        add_constraint(std::make_shared<edit_constraint>(v, s, weight));
+        return *this;
+    }
+
+    /** Start editing all the components that have edit variables.
+     * Components with edit variables cannot be merged into others until
+     * the edit is over. */
+    partitioned_solver& begin_edit();
+
+    /** Resolve, and remove the edit variables of all components. */
+    partitioned_solver& end_edit();
+
+    partitioned_solver& suggest_value(const variable& v, double x);
+
+    /** Resolve the components that had a new value suggested. */
+    void resolve();
+
+    /** Split the components that might have come apart, and solve the
+     ** ones that have changed. */
+    partitioned_solver& solve();
+
+    /** Only solve the components that are read.
+     * In lazy mode, solve() and resolve() do nothing.  A component is
+     * brought up to date when one of its variables is read through
+     * value(), or when lazy mode is switched off again.  Until then,
+     * the variables keep the values they had.  This makes it cheap to
+     * keep off-screen content in the same solver. */
+    partitioned_solver& set_lazy(bool on = true);
+
+    bool is_lazy() const { return lazy_; }
+
+    /** Get the value of a variable, after solving its component if it
+     ** has changed. */
+    double value(const variable& v);
+
+    /** Check if the component of a variable has changes that have not
+     ** been solved yet. */
+    bool is_dirty(const variable& v) const;
+
+    /** The number of components.
+     * This can be too low after a constraint was removed, until solve()
+     * has been called. */
+    size_t components() const { return components_.size(); }
+
+    /** Get the solver of the component a variable is in.
+     * \return The solver, or a null pointer if the variable is not in any
+     *         of the constraints */
+    const simplex_solver* component(const variable& v) const;
+
+    bool contains_constraint(const constraint& c) const
+    {
+        return constraints_.count(c) > 0;
+    }
+
+    size_t threads() const { return pool_ ? pool_->size() : 1; }
+
+protected:
+    solver& add_constraint_(const constraint& c);
+    solver& remove_constraint_(const constraint& c);
+
+private:
+    struct component_info
+    {
+        simplex_solver solv;
+        constraint_list constraints;
+        variable_set vars;
+        // Constraints were added or removed since the last solve().
+        bool needs_solving;
+        // A new value was suggested since the last resolve().
+        bool needs_resolving;
+        // A constraint was removed since the last check for a split.
+        bool may_split;
+
+        component_info()
+            : needs_solving{false}
+            , needs_resolving{false}
+            , may_split{false}
+        {
+            solv.set_autosolve(false);
+        }
+    };
+
+    typedef std::unique_ptr<component_info> component_ptr;
+
+    component_info* new_component();
+
+    // Bring a single component up to date.
+    void update(component_info& comp);
+
+    // Move all the constraints of one component into another.
+    void merge(component_info& from, component_info& into);
+
+    void split(component_info& comp);
+
+    void remove_empty_components();
+
+    // Run an action on the solvers of some components, in parallel if
+    // there is a thread pool.
+    void run(const std::vector<component_info*>& comps,
+             const std::function<void(simplex_solver&)>& action);
+
+private:
+    std::vector<component_ptr> components_;
+    std::unordered_map<variable, component_info*> owner_;
+    std::unordered_map<constraint,
+                       std::pair<component_info*, constraint_list::iterator>>
+        constraints_;
+    std::unique_ptr<thread_pool> pool_;
+    bool lazy_;
+};
+
+} // namespace rhea
@@ -6,6 +6,8 @@
 #include "simplex_solver.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <queue>
 
 #include "errors_expl.hpp"
@@ -19,34 +21,92 @@ simplex_solver::simplex_solver()
     : solver()
     , objective_(std::make_shared<objective_variable>())
     , auto_reset_stay_constants_(true)
+    , parametric_(false)
+    , speculative_(false)
     , needs_solving_(false)
     , explain_failure_(false)
+    , resolving_(false)
+    , basis_cache_budget_(0)
+    , basis_cache_bytes_(0)
+    , basis_cache_hits_(0)
+    , basis_cache_misses_(0)
 {
-    rows_[objective_]; // Create an empty row for the objective
+    rows_.write()[objective_]; // Create an empty row for the objective
     cedcns_.push(0);
 }
 
 template <typename container, typename func>
 void remove_from_container_if(container& c, func pred)
 {
-    c.erase(std::remove_if(c.begin(), c.end(), pred));
+    c.erase(std::remove_if(c.begin(), c.end(), pred), c.end());
 }
 
-simplex_solver::expression_result
-simplex_solver::make_expression(const constraint& c)
+// Scale the expression of a constraint so that its first term has a
+// coefficient of 1.  Inequalities can only be scaled by a positive
+// number, so their first coefficient becomes either 1 or -1.
+static linear_expression normalized(const constraint& c)
 {
-    expression_result result;
+    auto expr = c.expression();
+    if (expr.is_constant())
+        return expr;
 
-    auto& expr = result.expr;
-    auto cexpr = c.expression();
-    expr.set_constant(cexpr.constant());
+    double first = expr.terms().begin()->second;
+    expr /= c.is_inequality() ? std::abs(first) : first;
+    return expr;
+}
+
+static size_t normalized_hash(const constraint& c,
+                              const linear_expression& expr)
+{
+    size_t result = c.is_inequality() ? 1 : 0;
+    for (auto& term : expr.terms())
+        result = result * 31 + term.first.hash();
+
+    return result;
+}
+
+static bool approx_equal(const linear_expression& a,
+                         const linear_expression& b)
+{
+    if (!approx(a.constant(), b.constant())
+        || a.terms().size() != b.terms().size())
+        return false;
+
+    return std::equal(a.terms().begin(), a.terms().end(), b.terms().begin(),
+                      [](const linear_expression::term& x,
+                         const linear_expression::term& y) {
+        return x.first.is(y.first) && approx(x.second, y.second);
+    });
+}
+
+// Only required linear constraints can share a row; for all other
+// constraints a duplicate changes the objective function.
+static bool is_shareable(const constraint& c)
+{
+    return c.is_required() && !c.is_edit_constraint()
+           && !c.is_stay_constraint();
+}
 
+linear_expression simplex_solver::reduce(const linear_expression& cexpr) const
+{
+    linear_expression expr{cexpr.constant()};
     for (const auto& term : cexpr.terms()) {
         if (is_basic_var(term.first))
             expr += row_expression(term.first) * term.second;
         else
             expr += term;
     }
+    return expr;
+}
+
+simplex_solver::expression_result
+simplex_solver::make_expression(const constraint& c,
+                                const linear_expression& reduced)
+{
+    expression_result result;
+    result.expr = reduced;
+
+    auto& expr = result.expr;
 
     if (c.is_inequality()) {
         // cn is an inequality, so add a slack variable.  The original
@@ -137,29 +197,101 @@ simplex_solver::make_expression(const constraint& c)
 
 solver& simplex_solver::add_constraint_(const constraint& c)
 {
+    constraint_list explanation;
+    auto result
+        = try_add_constraint(c, explain_failure_ ? &explanation : nullptr);
+
+    if (result == status::edit_misuse)
+        RHEA_THROW(edit_misuse(c.as<edit_constraint>().var()));
+
+    // The explanation is only filled in when explaining, but the type of
+    // the exception doesn't depend on it.
+    if (result != status::ok)
+        RHEA_THROW(required_failure_with_explanation(std::move(explanation)));
+
+    return *this;
+}
+
+status simplex_solver::try_add_constraint(const constraint& c,
+                                          constraint_list* explanation)
+{
+    finish_resolve();
+    flush_parametric();
+    auto result = insert_constraint(c, explanation);
+    if (result == status::ok && auto_solve_)
+        solve_();
+
+    return result;
+}
+
+// Check if the reduced expression of a required equality consists of
+// nothing but the markers of other required equalities, with a constant
+// that isn't zero.  Since dummy variables are always zero, it can never
+// be satisfied.
+static bool contradicts_required(const constraint& c,
+                                 const linear_expression& reduced)
+{
+    if (!c.is_required() || c.is_inequality() || near_zero(reduced.constant()))
+        return false;
+
+    for (auto& term : reduced.terms()) {
+        if (!term.first.is_dummy())
+            return false;
+    }
+    return true;
+}
+
+status simplex_solver::insert_constraint(const constraint& c,
+                                         constraint_list* explanation)
+{
+    clear_basis_cache();
+
     if (c.is_edit_constraint()) {
         auto& ec = c.as<edit_constraint>();
         const auto& v = ec.var();
         if (!v.is_external())
-            throw edit_misuse(v);
+            return status::edit_misuse;
     }
 
-    auto r = make_expression(c);
+    // Reject what can be rejected before the tableau is touched; there
+    // is nothing to roll back in that case.
+    bool shareable = is_shareable(c);
+    if (shareable && violates_bounds(c)) {
+        if (explanation)
+            *explanation = bounds_explanation(c);
 
-    bool added_ok_directly = false;
-    try {
-        added_ok_directly = try_adding_directly(r.expr);
-    } catch (required_failure&) {
-        remove_constraint_(c);
-        throw;
+        return status::required_failure;
     }
 
-    if (!added_ok_directly) {
-        auto result = add_with_artificial_variable(r.expr);
-        if (!result.first) {
-            remove_constraint_(c);
-            throw required_failure_with_explanation(std::move(result.second));
+    auto reduced = reduce(c.expression());
+    if (contradicts_required(c, reduced)) {
+        if (explanation) {
+            explanation->clear();
+            for (auto& term : reduced.terms())
+                explanation->push_back(constraints_marked_.at(term.first));
+
+            explanation->push_back(c);
         }
+        return status::required_failure;
+    }
+
+    if (shareable && share_row(c, reduced)) {
+        register_bounds(c);
+        return status::ok;
+    }
+
+    auto r = make_expression(c, reduced);
+
+    if (!try_adding_directly(r.expr)
+        && !add_with_artificial_variable(r.expr, explanation)) {
+        // Looking for a feasible solution has pivoted the tableau, so
+        // it's no longer optimal; solve it like after a removal.
+        reset_stay_constants();
+        erase_constraint(c);
+        if (auto_solve_)
+            solve_();
+
+        return status::required_failure;
     }
 
     needs_solving_ = true;
@@ -170,23 +302,248 @@ solver& simplex_solver::add_constraint_(const constraint& c)
                                      r.previous_constant);
     }
 
+    if (shareable) {
+        required_index_.emplace(normalized_hash(c, normalized(c)), c);
+        register_bounds(c);
+    }
+    return status::ok;
+}
+
+bool simplex_solver::violates_bounds(const constraint& c) const
+{
+    auto expr = c.expression();
+    double lower = expr.constant(), upper = expr.constant();
+    for (auto& term : expr.terms()) {
+        auto found = bounds_.find(term.first);
+        if (found == bounds_.end())
+            return false;
+
+        const var_bounds& b = found->second;
+        if (term.second > 0) {
+            lower += term.second * b.lower;
+            upper += term.second * b.upper;
+        } else {
+            lower += term.second * b.upper;
+            upper += term.second * b.lower;
+        }
+    }
+
+    if (upper < 0.0 && !near_zero(upper))
+        return true;
+
+    return !c.is_inequality() && lower > 0.0 && !near_zero(lower);
+}
+
+constraint_list simplex_solver::bounds_explanation(const constraint& c) const
+{
+    constraint_list result;
+    auto expr = c.expression();
+    for (auto& term : expr.terms()) {
+        auto found = bounds_.find(term.first);
+        if (found != bounds_.end()) {
+            result.insert(result.end(), found->second.constraints.begin(),
+                          found->second.constraints.end());
+        }
+    }
+    result.push_back(c);
+    return result;
+}
+
+// Calculate the bounds on a variable that follow from a constraint on
+// only that variable.
+static void tighten(double& lower, double& upper, const constraint& c)
+{
+    auto expr = c.expression();
+    double a = expr.terms().begin()->second;
+    double x = -expr.constant() / a;
+    if (!c.is_inequality() || a > 0)
+        lower = std::max(lower, x);
+    if (!c.is_inequality() || a < 0)
+        upper = std::min(upper, x);
+}
+
+void simplex_solver::register_bounds(const constraint& c)
+{
+    auto expr = c.expression();
+    if (expr.terms().size() != 1)
+        return;
+
+    // Implied constraints are registered again when they get a row of
+    // their own, but should only be unregistered once.
+    auto& b = bounds_[expr.terms().begin()->first];
+    if (std::find(b.constraints.begin(), b.constraints.end(), c)
+        != b.constraints.end())
+        return;
+
+    tighten(b.lower, b.upper, c);
+    b.constraints.push_back(c);
+}
+
+void simplex_solver::unregister_bounds(const constraint& c)
+{
+    auto expr = c.expression();
+    if (expr.terms().size() != 1)
+        return;
+
+    auto found = bounds_.find(expr.terms().begin()->first);
+    if (found == bounds_.end())
+        return;
+
+    auto& cl = found->second.constraints;
+    auto i = std::find(cl.begin(), cl.end(), c);
+    if (i == cl.end())
+        return;
+
+    cl.erase(i);
+    if (cl.empty()) {
+        bounds_.erase(found);
+        return;
+    }
+
+    var_bounds b;
+    for (auto& bc : cl)
+        tighten(b.lower, b.upper, bc);
+
+    found->second.lower = b.lower;
+    found->second.upper = b.upper;
+}
+
+bool simplex_solver::share_row(const constraint& c,
+                               const linear_expression& expr)
+{
+    auto norm = normalized(c);
+    auto range = required_index_.equal_range(normalized_hash(c, norm));
+    for (auto i = range.first; i != range.second; ++i) {
+        const constraint& owner = i->second;
+        if (owner.is_inequality() == c.is_inequality()
+            && approx_equal(normalized(owner), norm)) {
+            duplicates_[owner].push_back(c);
+            shared_rows_.emplace(c, owner);
+            return true;
+        }
+    }
+
+    // If the expression only consists of the markers of required
+    // equalities, it is always satisfied as long as those are in the
+    // tableau.  The markers of edit and stay constraints don't count,
+    // since the constant of their row changes whenever the value of
+    // their variable does.
+    constraint_list owners;
+    for (auto& term : expr.terms()) {
+        if (!term.first.is_dummy())
+            return false;
+
+        auto found = constraints_marked_.find(term.first);
+        if (found == constraints_marked_.end()
+            || found->second.is_edit_constraint()
+            || found->second.is_stay_constraint())
+            return false;
+
+        owners.push_back(found->second);
+    }
+
+    if (c.is_inequality() ? expr.constant() < 0.0 && !near_zero(expr.constant())
+                          : !near_zero(expr.constant()))
+        return false;
+
+    implied_.emplace(c, std::move(owners));
+    return true;
+}
+
+bool simplex_solver::unshare_row(const constraint& c)
+{
+    if (implied_.erase(c) > 0)
+        return true;
+
+    auto is = shared_rows_.find(c);
+    if (is != shared_rows_.end()) {
+        auto id = duplicates_.find(is->second);
+        assert(id != duplicates_.end());
+        id->second.erase(std::find(id->second.begin(), id->second.end(), c));
+        if (id->second.empty())
+            duplicates_.erase(id);
+
+        shared_rows_.erase(is);
+        return true;
+    }
+
+    auto id = duplicates_.find(c);
+    if (id == duplicates_.end())
+        return false;
+
+    // Hand the row over to the first duplicate.
+    constraint_list rest{std::move(id->second)};
+    duplicates_.erase(id);
+    constraint heir{rest.front()};
+    rest.pop_front();
+    shared_rows_.erase(heir);
+
+    variable marker{marker_vars_[c]};
+    marker_vars_.erase(c);
+    marker_vars_[heir] = marker;
+    constraints_marked_[marker] = heir;
+
+    for (auto& ii : implied_)
+        std::replace(ii.second.begin(), ii.second.end(), c, heir);
+
+    auto range = required_index_.equal_range(normalized_hash(c, normalized(c)));
+    for (auto i = range.first; i != range.second; ++i) {
+        if (i->second == c) {
+            i->second = heir;
+            break;
+        }
+    }
+
+    if (!rest.empty()) {
+        for (auto& d : rest)
+            shared_rows_[d] = heir;
+
+        duplicates_[heir] = std::move(rest);
+    }
+    return true;
+}
+
+solver& simplex_solver::remove_constraint_(const constraint& c)
+{
+    if (try_remove_constraint(c) != status::ok)
+        RHEA_THROW(constraint_not_found());
+
+    return *this;
+}
+
+status simplex_solver::try_remove_constraint(const constraint& c)
+{
+    finish_resolve();
+    flush_parametric();
+    if (is_shareable(c))
+        unregister_bounds(c);
+
+    if (unshare_row(c))
+        return status::ok;
+
+    if (marker_vars_.count(c) == 0)
+        return status::constraint_not_found;
+
+    reset_stay_constants();
+    erase_constraint(c);
+
     if (auto_solve_)
         solve_();
 
-    return *this;
+    return status::ok;
 }
 
-solver& simplex_solver::remove_constraint_(const constraint& c)
+void simplex_solver::erase_constraint(const constraint& c)
 {
     needs_solving_ = true;
-    reset_stay_constants();
+    clear_basis_cache();
 
     auto& rowexpr = row_expression(objective_);
     auto i = error_vars_.find(c);
     if (i != error_vars_.end()) {
         for (const variable& var : i->second) {
             if (is_basic_var(var)) {
-                const linear_expression& expr = row_expression(var);
+                const linear_expression& expr = read_row(var);
                 rowexpr.add(expr * -c.adjusted_symbolic_weight(), objective_,
                             *this);
             } else {
@@ -197,8 +554,7 @@ solver& simplex_solver::remove_constraint_(const constraint& c)
     }
 
     auto im = marker_vars_.find(c);
-    if (im == marker_vars_.end())
-        throw constraint_not_found();
+    assert(im != marker_vars_.end());
 
     variable marker{im->second};
     marker_vars_.erase(im);
@@ -206,7 +562,9 @@ solver& simplex_solver::remove_constraint_(const constraint& c)
 
     if (!is_basic_var(marker)) {
         // Try to make this marker variable basic.
-        auto& col = columns_[marker];
+        variable_set none;
+        auto ic = columns_->find(marker);
+        const auto& col = ic == columns_->end() ? none : *ic->second;
         bool exit_var_set = false;
         double min_ratio = 0.0;
         variable exit_var{variable::nil_var()};
@@ -252,109 +610,884 @@ solver& simplex_solver::remove_constraint_(const constraint& c)
             }
         }
 
-        if (!exit_var_set) {
-            // exitVar is still nil
-            // If col is empty, then exitVar doesn't occur in any equations,
-            // so just remove it.  Otherwise pick an exit var from among the
-            // unrestricted variables whose equation involves the marker var
-            if (col.empty()) {
-                remove_column(marker);
-            } else {
-                for (auto& v : col) {
-                    if (!v.is(objective_)) {
-                        exit_var = v;
-                        exit_var_set = true;
-                        break;
-                    }
+        if (!exit_var_set) {
+            // exitVar is still nil
+            // If col is empty, then exitVar doesn't occur in any equations,
+            // so just remove it.  Otherwise pick an exit var from among the
+            // unrestricted variables whose equation involves the marker var
+            if (col.empty()) {
+                remove_column(marker);
+            } else {
+                for (auto& v : col) {
+                    if (!v.is(objective_)) {
+                        exit_var = v;
+                        exit_var_set = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (exit_var_set)
+            pivot(marker, exit_var);
+    }
+
+    if (is_basic_var(marker))
+        remove_row(marker);
+
+    // Delete any error variables.  If cn is an inequality, it also
+    // contains a slack variable; but we use that as the marker variable
+    // and so it has been deleted when we removed its row.
+    if (i != error_vars_.end()) {
+        for (const auto& v : i->second) {
+            if (!v.is(marker))
+                remove_column(v);
+        }
+    }
+
+    if (c.is_stay_constraint()) {
+        // Required stays don't have error variables, their dummy marker
+        // is used instead.
+        auto pred = [&](const variable& x) {
+            return x.is(marker)
+                   || (i != error_vars_.end() && i->second.count(x) > 0);
+        };
+        remove_from_container_if(stay_plus_error_vars_, pred);
+        remove_from_container_if(stay_minus_error_vars_, pred);
+    } else if (c.is_edit_constraint()) {
+        // The edit_info is missing if the constraint was rejected by
+        // insert_constraint().
+        auto ei = std::find(edit_info_list_.begin(), edit_info_list_.end(),
+                            c);
+        if (ei != edit_info_list_.end()) {
+            remove_column(ei->minus);
+            // ei->plus is a marker and will be removed later
+            edit_info_list_.erase(ei);
+        }
+    }
+
+    if (i != error_vars_.end())
+        error_vars_.erase(i);
+
+    if (is_shareable(c)) {
+        auto range
+            = required_index_.equal_range(normalized_hash(c, normalized(c)));
+        for (auto ir = range.first; ir != range.second; ++ir) {
+            if (ir->second == c) {
+                required_index_.erase(ir);
+                break;
+            }
+        }
+    }
+
+    // The constraints that were implied by this one need a row of their
+    // own now.
+    constraint_list readd;
+    for (auto ii = implied_.begin(); ii != implied_.end();) {
+        auto& owners = ii->second;
+        if (std::find(owners.begin(), owners.end(), c) != owners.end()) {
+            readd.push_back(ii->first);
+            ii = implied_.erase(ii);
+        } else {
+            ++ii;
+        }
+    }
+    for (auto& ic : readd) {
+        auto result = insert_constraint(ic, nullptr);
+        assert(result == status::ok);
+        (void)result;
+    }
+}
+
+void simplex_solver::shrink_to_fit()
+{
+    tableau::shrink_to_fit();
+
+    stay_plus_error_vars_.shrink_to_fit();
+    stay_minus_error_vars_.shrink_to_fit();
+    for (auto& e : error_vars_)
+        e.second.rehash(0);
+
+    error_vars_.rehash(0);
+    marker_vars_.rehash(0);
+    constraints_marked_.rehash(0);
+    required_index_.rehash(0);
+    bounds_.rehash(0);
+    duplicates_.rehash(0);
+    shared_rows_.rehash(0);
+    suggested_.rehash(0);
+    row_deltas_.rehash(0);
+}
+
+void simplex_solver::replace_variables(const std::vector<variable>& from,
+                                       const std::vector<variable>& to)
+{
+    if (from.size() != to.size())
+        RHEA_THROW(edit_misuse());
+
+    finish_resolve();
+    flush_parametric();
+
+    std::unordered_map<variable, variable> map;
+    for (size_t i = 0; i < from.size(); ++i) {
+        if (has_edit_var(from[i]))
+            RHEA_THROW(edit_misuse(from[i]));
+
+        map.emplace(from[i], to[i]);
+
+        // The bounds are only a shortcut; the constraints that set them
+        // still mention the old variable, so they can't be kept.
+        bounds_.erase(from[i]);
+        if (edit_hints_.erase(from[i]) > 0)
+            edit_hints_.insert(to[i]);
+    }
+
+    tableau::replace_variables(map);
+    clear_basis_cache();
+    set_external_variables();
+}
+
+simplex_solver simplex_solver::clone() const
+{
+    simplex_solver result(*this);
+    result.speculative_ = true;
+    result.on_resolve = nullptr;
+    result.on_variable_change = nullptr;
+    result.transactions_.clear();
+    return result;
+}
+
+simplex_solver& simplex_solver::begin_transaction()
+{
+    flush_parametric();
+    transactions_.push_back(std::make_shared<simplex_solver>(*this));
+    return *this;
+}
+
+simplex_solver& simplex_solver::commit()
+{
+    if (transactions_.empty())
+        RHEA_THROW(transaction_misuse());
+
+    transactions_.pop_back();
+    return *this;
+}
+
+simplex_solver& simplex_solver::rollback()
+{
+    if (transactions_.empty())
+        RHEA_THROW(transaction_misuse());
+
+    // The saved copy has the transactions that were open before this
+    // one.
+    auto saved = transactions_.back();
+    auto resolve_cb = std::move(on_resolve);
+    auto change_cb = std::move(on_variable_change);
+    bool speculative = speculative_;
+    *this = *saved;
+    on_resolve = std::move(resolve_cb);
+    on_variable_change = std::move(change_cb);
+    speculative_ = speculative;
+
+    set_external_variables();
+    return *this;
+}
+
+void simplex_solver::resolve()
+{
+    resolve_(true);
+}
+
+status simplex_solver::resolve_for(size_t max_pivots)
+{
+    bool done = resolve_(true, max_pivots,
+                         std::chrono::steady_clock::time_point::max());
+    return done ? status::ok : status::partial;
+}
+
+status simplex_solver::resolve_for(std::chrono::steady_clock::duration limit)
+{
+    bool done = resolve_(true, std::numeric_limits<size_t>::max(),
+                         std::chrono::steady_clock::now() + limit);
+    return done ? status::ok : status::partial;
+}
+
+void simplex_solver::resolve_(bool update_externals)
+{
+    resolve_(update_externals, std::numeric_limits<size_t>::max(),
+             std::chrono::steady_clock::time_point::max());
+}
+
+bool simplex_solver::resolve_(bool update_externals, size_t max_pivots,
+                              std::chrono::steady_clock::time_point deadline)
+{
+    if (parametric_resolve(update_externals))
+        return true;
+
+    flush_parametric();
+    // Halfway through, the basis is neither worth caching nor worth
+    // giving up for a cached one.
+    if (basis_cache_budget_ > 0 && !infeasible_rows_.empty()
+        && !resolving_) {
+        cache_basis();
+        if (restore_cached_basis())
+            ++basis_cache_hits_;
+        else
+            ++basis_cache_misses_;
+    }
+
+    resolving_ = !dual_optimize(max_pivots, deadline);
+    if (resolving_)
+        return false;
+
+    if (update_externals)
+        set_external_variables();
+
+    infeasible_rows_.clear();
+    if (auto_reset_stay_constants_)
+        reset_stay_constants();
+
+    if (parametric_)
+        build_parametric_map();
+
+    return true;
+}
+
+std::vector<double>
+simplex_solver::solve_trajectory(const variable& v,
+                                 const std::vector<double>& values,
+                                 const std::vector<variable>& outputs)
+{
+    if (!has_edit_var(v))
+        RHEA_THROW(edit_misuse(v));
+
+    std::vector<double> result;
+    result.reserve(values.size() * outputs.size());
+    for (double x : values) {
+        suggest_value(v, x);
+        resolve_(false);
+        for (auto& out : outputs)
+            result.push_back(solution_value(out));
+    }
+
+    // Leave the variables at the last keyframe.
+    set_external_variables();
+    return result;
+}
+
+std::vector<double>
+simplex_solver::solve_scenarios(const std::vector<variable>& edits,
+                                const std::vector<double>& values,
+                                const std::vector<variable>& outputs)
+{
+    size_t n = edits.size();
+    if (n == 0 ? !values.empty() : values.size() % n != 0)
+        RHEA_THROW(edit_misuse());
+
+    size_t count = n == 0 ? 0 : values.size() / n;
+
+    std::vector<double> start;
+    for (auto& v : edits)
+        start.push_back(edit_value(v));
+
+    // The stay constants have to stay where they are, or the scenarios
+    // would depend on the ones that were solved before them.
+    bool was_parametric = parametric_;
+    bool was_resetting = auto_reset_stay_constants_;
+    parametric_ = true;
+    auto_reset_stay_constants_ = false;
+
+    // Keep the scenarios in the inner loops, so the compiler can
+    // vectorize them.
+    std::vector<double> in(n * count);
+    for (size_t s = 0; s < count; ++s) {
+        for (size_t k = 0; k < n; ++k)
+            in[k * count + s] = values[s * n + k];
+    }
+
+    size_t width = n + 1;
+    std::vector<double> result(count * outputs.size());
+    std::vector<double> sum(count);
+    std::vector<char> done(count, 0), covered(count);
+    affine_region region;
+    auto evaluate = [&](const double* row) {
+        for (size_t s = 0; s < count; ++s)
+            sum[s] = row[0];
+
+        for (size_t k = 0; k < n; ++k) {
+            const double a = row[k + 1];
+            const double* x = &in[k * count];
+            for (size_t s = 0; s < count; ++s)
+                sum[s] += a * x[s];
+        }
+    };
+
+    for (size_t first = 0; first < count; ++first) {
+        if (done[first])
+            continue;
+
+        for (size_t k = 0; k < n; ++k)
+            suggest_value(edits[k], values[first * n + k]);
+
+        resolve_(false);
+        for (size_t j = 0; j < outputs.size(); ++j)
+            result[first * outputs.size() + j] = solution_value(outputs[j]);
+
+        done[first] = 1;
+        if (!parametric_region(edits, outputs, region))
+            continue;
+
+        // Find the other scenarios that are feasible in this basis.
+        for (size_t s = 0; s < count; ++s)
+            covered[s] = !done[s];
+
+        region.clip(in.data(), n, count, covered.data(), sum.data());
+        for (size_t j = 0; j < outputs.size(); ++j) {
+            evaluate(&region.values[j * width]);
+            for (size_t s = 0; s < count; ++s) {
+                if (covered[s])
+                    result[s * outputs.size() + j] = sum[s];
+            }
+        }
+        for (size_t s = 0; s < count; ++s)
+            done[s] |= covered[s];
+    }
+
+    for (size_t k = 0; k < n; ++k)
+        suggest_value(edits[k], start[k]);
+
+    resolve_(true);
+    parametric_ = was_parametric;
+    auto_reset_stay_constants_ = was_resetting;
+    if (!parametric_)
+        flush_parametric();
+
+    return result;
+}
+
+double simplex_solver::edit_value(const variable& v) const
+{
+    auto e = std::find(edit_info_list_.rbegin(), edit_info_list_.rend(), v);
+    if (e == edit_info_list_.rend())
+        RHEA_THROW(edit_misuse(v));
+
+    return e->prev_constant;
+}
+
+double simplex_solver::solution_value(const variable& v) const
+{
+    auto i = rows_->find(v);
+    if (i != rows_->end())
+        return i->second->constant();
+
+    return columns_has_key(v) ? 0.0 : v.value();
+}
+
+std::pair<double, double>
+simplex_solver::parametric_range(const variable& v) const
+{
+    double lower = -std::numeric_limits<double>::infinity();
+    double upper = std::numeric_limits<double>::infinity();
+    if (!parametric_ready())
+        return {upper, lower};
+
+    // Every restricted row needs to stay non-negative:
+    //   c + m * x >= 0
+    // with c the constant of the row when x is zero and the other edit
+    // constants are at their suggested values.
+    const auto& m = pmap_;
+    size_t n = m.edits.size();
+    for (size_t r : m.restricted) {
+        double c = m.constants[r];
+        double slope = 0.0;
+        for (size_t k = 0; k < n; ++k) {
+            double a = m.coeffs[r * n + k];
+            if (m.edits[k]->v.is(v)) {
+                slope += a;
+                c -= a * m.at[k];
+            } else {
+                c += a * (m.edits[k]->prev_constant - m.at[k]);
+            }
+        }
+        if (slope > 0.0)
+            lower = std::max(lower, -c / slope);
+        else if (slope < 0.0)
+            upper = std::min(upper, -c / slope);
+        else if (c < 0.0)
+            return {upper, lower};
+    }
+    return {lower, upper};
+}
+
+bool simplex_solver::parametric_region(const std::vector<variable>& edits,
+                                       const std::vector<variable>& outputs,
+                                       affine_region& result) const
+{
+    if (!parametric_ready())
+        return false;
+
+    const auto& m = pmap_;
+    size_t n = m.edits.size();
+    size_t width = edits.size() + 1;
+
+    // The position of every edit constant of the map in the list, or
+    // zero if it's not in there.
+    std::vector<size_t> column(n, 0);
+    for (size_t k = 0; k < n; ++k) {
+        for (size_t i = 0; i < edits.size(); ++i) {
+            if (m.edits[k]->v.is(edits[i]))
+                column[k] = i + 1;
+        }
+    }
+
+    // Write a row of the map as c + sum(a_i * edits_i), with the edit
+    // constants that are not in the list folded into c.
+    auto describe = [&](size_t r, double* out) {
+        out[0] = m.constants[r];
+        for (size_t k = 0; k < n; ++k) {
+            double a = m.coeffs[r * n + k];
+            if (column[k] == 0) {
+                out[0] += a * (m.edits[k]->prev_constant - m.at[k]);
+            } else {
+                out[0] -= a * m.at[k];
+                out[column[k]] += a;
+            }
+        }
+    };
+
+    std::unordered_map<variable, size_t> row;
+    for (size_t r = 0; r < m.vars.size(); ++r)
+        row.emplace(m.vars[r], r);
+
+    result.values.assign(outputs.size() * width, 0.0);
+    for (size_t j = 0; j < outputs.size(); ++j) {
+        auto i = row.find(outputs[j]);
+        if (i == row.end())
+            result.values[j * width] = solution_value(outputs[j]);
+        else
+            describe(i->second, &result.values[j * width]);
+    }
+
+    result.bounds.assign(m.restricted.size() * width, 0.0);
+    for (size_t j = 0; j < m.restricted.size(); ++j)
+        describe(m.restricted[j], &result.bounds[j * width]);
+
+    return true;
+}
+
+void simplex_solver::affine_region::clip(const double* in, size_t edits,
+                                         size_t count, char* inside,
+                                         double* scratch,
+                                         double tolerance) const
+{
+    // Keep the points in the inner loops, so the compiler can vectorize
+    // them.
+    size_t width = edits + 1;
+    for (size_t i = 0; i < bounds.size(); i += width) {
+        const double* row = &bounds[i];
+        for (size_t s = 0; s < count; ++s)
+            scratch[s] = row[0];
+
+        for (size_t k = 0; k < edits; ++k) {
+            const double a = row[k + 1];
+            const double* x = in + k * count;
+            for (size_t s = 0; s < count; ++s)
+                scratch[s] += a * x[s];
+        }
+        for (size_t s = 0; s < count; ++s)
+            inside[s] &= scratch[s] >= -tolerance;
+    }
+}
+
+simplex_solver& simplex_solver::set_basis_cache(size_t bytes)
+{
+    basis_cache_budget_ = bytes;
+    while (basis_cache_bytes_ > basis_cache_budget_) {
+        basis_cache_bytes_ -= basis_cache_.back().bytes;
+        basis_cache_.pop_back();
+    }
+    return *this;
+}
+
+void simplex_solver::clear_basis_cache()
+{
+    basis_cache_.clear();
+    basis_cache_bytes_ = 0;
+}
+
+// Identify a basis by its set of basic variables.
+static size_t basis_signature(const tableau::rows_map& rows)
+{
+    std::hash<variable> hash;
+    size_t result = rows.size();
+    for (auto& row : rows)
+        result += hash(row.first) * 0x9e3779b97f4a7c15ull;
+
+    return result;
+}
+
+// A rough estimate of the memory used by a copy of the tableau.
+static size_t estimated_size(const tableau::rows_map& rows,
+                             const tableau::columns_map& columns)
+{
+    const size_t node = 4 * sizeof(void*);
+    size_t result = (rows.size() + columns.size()) * node;
+    for (auto& row : rows)
+        result += row.second->terms().size() * sizeof(linear_expression::term);
+
+    for (auto& col : columns)
+        result += col.second->size() * (node + sizeof(variable));
+
+    return result;
+}
+
+void simplex_solver::cache_basis()
+{
+    size_t signature = basis_signature(*rows_);
+    for (auto i = basis_cache_.begin(); i != basis_cache_.end(); ++i) {
+        if (i->signature == signature) {
+            basis_cache_.splice(basis_cache_.begin(), basis_cache_, i);
+            return;
+        }
+    }
+
+    size_t bytes = estimated_size(*rows_, *columns_);
+    if (bytes > basis_cache_budget_)
+        return;
+
+    while (basis_cache_bytes_ + bytes > basis_cache_budget_) {
+        basis_cache_bytes_ -= basis_cache_.back().bytes;
+        basis_cache_.pop_back();
+    }
+    basis_cache_.push_front(cached_basis{signature, bytes, rows_, columns_,
+                                        external_rows_,
+                                        external_parametric_vars_});
+    basis_cache_bytes_ += bytes;
+
+    // The rows are shared with the cache now, so any pointers into them
+    // have to be looked up again.
+    ++version_;
+}
+
+bool simplex_solver::restore_cached_basis()
+{
+    // The current tableau is infeasible, but it still describes a point
+    // that satisfies all equations for the current constants: the basic
+    // variables take the value of their row's constant, the parametric
+    // ones are zero.  The rows of another basis hold for every such
+    // point, so their constants follow from that.
+    auto value = [&](const variable& v) {
+        auto i = rows_->find(v);
+        return i == rows_->end() ? 0.0 : i->second->constant();
+    };
+
+    size_t current = basis_signature(*rows_);
+    for (auto i = basis_cache_.begin(); i != basis_cache_.end(); ++i) {
+        if (i->signature == current)
+            continue;
+
+        bool feasible = true;
+        std::vector<double> constants;
+        constants.reserve(i->rows->size());
+        for (auto& row : *i->rows) {
+            double c = value(row.first);
+            for (auto& term : row.second->terms())
+                c -= term.second * value(term.first);
+
+            if (row.first.is_restricted() && c < 0.0) {
+                if (!near_zero(c)) {
+                    feasible = false;
+                    break;
                 }
+                c = 0.0;
             }
+            constants.push_back(c);
         }
+        if (!feasible)
+            continue;
 
-        if (exit_var_set)
-            pivot(marker, exit_var);
+        auto ic = constants.begin();
+        for (auto& row : i->rows.write())
+            row.second.write().set_constant(*ic++);
+
+        rows_ = i->rows;
+        columns_ = i->columns;
+        external_rows_ = i->external_rows;
+        external_parametric_vars_ = i->external_parametric_vars;
+        infeasible_rows_.clear();
+        ++version_;
+
+        basis_cache_.splice(basis_cache_.begin(), basis_cache_, i);
+        return true;
     }
+    return false;
+}
 
-    if (is_basic_var(marker))
-        remove_row(marker);
+bool simplex_solver::parametric_resolve(bool update_externals)
+{
+    claim_rows();
+    if (!parametric_ready() || !infeasible_rows_.empty())
+        return false;
 
-    // Delete any error variables.  If cn is an inequality, it also
-    // contains a slack variable; but we use that as the marker variable
-    // and so it has been deleted when we removed its row.
-    if (i != error_vars_.end()) {
-        for (const auto& v : i->second) {
-            if (!v.is(marker))
-                remove_column(v);
-        }
+    auto& m = pmap_;
+    size_t n = m.edits.size();
+    for (size_t k = 0; k < n; ++k)
+        m.delta[k] = m.edits[k]->prev_constant - m.at[k];
+
+    // Plain loops over contiguous arrays, so the compiler can vectorize
+    // them.
+    const double* a = m.coeffs.data();
+    const double* d = m.delta.data();
+    double* next = m.scratch.data();
+    for (size_t r = 0; r < m.constants.size(); ++r, a += n) {
+        double sum = m.constants[r];
+        for (size_t k = 0; k < n; ++k)
+            sum += a[k] * d[k];
+
+        next[r] = sum;
     }
 
-    if (c.is_stay_constraint()) {
-        if (i != error_vars_.end()) {
-            auto pred = [&](variable x) { return i->second.count(x) > 0; };
-            remove_from_container_if(stay_plus_error_vars_, pred);
-            remove_from_container_if(stay_minus_error_vars_, pred);
+    for (size_t r : m.restricted) {
+        if (next[r] < 0)
+            return false;
+    }
+
+    m.constants.swap(m.scratch);
+    for (size_t k = 0; k < n; ++k)
+        m.at[k] = m.edits[k]->prev_constant;
+
+    if (auto_reset_stay_constants_) {
+        for (size_t r : m.stays)
+            m.constants[r] = 0.0;
+    }
+    for (size_t r = 0; r < m.constants.size(); ++r)
+        m.exprs[r]->set_constant(m.constants[r]);
+
+    if (update_externals) {
+        for (size_t r : m.externals)
+            change(m.vars[r], m.constants[r]);
+
+        needs_solving_ = false;
+    }
+    return true;
+}
+
+void simplex_solver::build_parametric_map()
+{
+    auto& m = pmap_;
+    m.valid = false;
+    m.edits.clear();
+    m.vars.clear();
+    if (edit_info_list_.empty())
+        return;
+
+    for (auto& e : edit_info_list_)
+        m.edits.push_back(&e);
+
+    // Find the rows that change with every edit constant, and by how
+    // much; see delta_edit_constant().
+    size_t n = m.edits.size();
+    std::unordered_map<variable, size_t> index;
+    std::vector<std::pair<size_t, double>> entries;
+    auto add = [&](const variable& row, size_t k, double coeff) {
+        auto i = index.emplace(row, m.vars.size());
+        if (i.second)
+            m.vars.push_back(row);
+
+        entries.emplace_back(i.first->second * n + k, coeff);
+    };
+    for (size_t k = 0; k < n; ++k) {
+        const edit_info& e = *m.edits[k];
+        if (is_basic_var(e.plus)) {
+            add(e.plus, k, 1.0);
+        } else if (is_basic_var(e.minus)) {
+            add(e.minus, k, -1.0);
+        } else {
+            auto ic = columns_->find(e.minus);
+            if (ic == columns_->end())
+                continue;
+
+            for (auto& v : *ic->second)
+                add(v, k, read_row(v).coefficient(e.minus));
         }
-    } else if (c.is_edit_constraint()) {
-        auto ei = std::find(edit_info_list_.begin(), edit_info_list_.end(),
-                            c);
-        assert(ei != edit_info_list_.end());
-        remove_column(ei->minus);
-        // ei->plus is a marker and will be removed later
-        edit_info_list_.erase(ei);
     }
 
-    if (i != error_vars_.end())
-        error_vars_.erase(i);
+    size_t rows = m.vars.size();
+    m.coeffs.assign(rows * n, 0.0);
+    for (auto& entry : entries)
+        m.coeffs[entry.first] = entry.second;
+
+    variable_set stays(stay_plus_error_vars_.begin(),
+                       stay_plus_error_vars_.end());
+    stays.insert(stay_minus_error_vars_.begin(), stay_minus_error_vars_.end());
+
+    m.exprs.resize(rows);
+    m.constants.resize(rows);
+    m.restricted.clear();
+    m.stays.clear();
+    m.externals.clear();
+    for (size_t r = 0; r < rows; ++r) {
+        const variable& v = m.vars[r];
+        m.exprs[r] = &row_expression(v);
+        m.constants[r] = m.exprs[r]->constant();
+        if (v.is_restricted())
+            m.restricted.push_back(r);
+        if (stays.count(v) > 0)
+            m.stays.push_back(r);
+        if (v.is_external())
+            m.externals.push_back(r);
+    }
 
-    if (auto_solve_)
-        solve_();
+    m.at.resize(n);
+    for (size_t k = 0; k < n; ++k)
+        m.at[k] = m.edits[k]->prev_constant;
 
-    return *this;
+    m.delta.resize(n);
+    m.scratch.resize(rows);
+    m.version = version();
+    m.valid = true;
 }
 
-void simplex_solver::resolve()
+void simplex_solver::flush_parametric()
 {
-    dual_optimize();
-    set_external_variables();
-    infeasible_rows_.clear();
-    if (auto_reset_stay_constants_)
-        reset_stay_constants();
+    if (!pmap_.valid)
+        return;
+
+    // The map may be out of date because the solver was copied, which
+    // shares the rows; the edit constants that are still pending have to
+    // be applied regardless.  A copy's map points into the edit list of
+    // the original, but the map is dropped whenever the edit variables
+    // change, so both lists are still in the order of the map.
+    pmap_.valid = false;
+    assert(pmap_.at.size() == edit_info_list_.size());
+    size_t k = 0;
+    for (auto& e : edit_info_list_) {
+        double delta{e.prev_constant - pmap_.at[k++]};
+        if (delta != 0.0)
+            delta_edit_constant(delta, e);
+    }
 }
 
 simplex_solver& simplex_solver::suggest_value(const variable& v, double x)
+{
+    if (try_suggest_value(v, x) != status::ok)
+        RHEA_THROW(edit_misuse(v));
+
+    return *this;
+}
+
+status simplex_solver::try_suggest_value(const variable& v, double x)
 {
     auto ei = std::find(edit_info_list_.rbegin(), edit_info_list_.rend(), v);
     if (ei == edit_info_list_.rend())
-        throw edit_misuse(v);
+        return status::edit_misuse;
+
+    bool lazy = parametric_ready();
+    if (!lazy)
+        flush_parametric();
 
     while (ei != edit_info_list_.rend()) {
         double delta{x - ei->prev_constant};
         ei->prev_constant = x;
-        delta_edit_constant(delta, ei->plus, ei->minus);
+        if (!lazy)
+            delta_edit_constant(delta, *ei);
+
         ei = std::find(std::next(ei), edit_info_list_.rend(), v);
     }
 
-    return *this;
+    return status::ok;
 }
 
 simplex_solver& simplex_solver::suggest_value(const constraint& c, double x)
 {
-    if (!c.is_edit_constraint()) {
-        throw edit_misuse();
+    if (try_suggest_value(c, x) != status::ok) {
+        if (!c.is_edit_constraint())
+            RHEA_THROW(edit_misuse());
+
+        RHEA_THROW(edit_misuse(c.as<edit_constraint>().var()));
     }
-    auto& e = c.as<edit_constraint>();
+    return *this;
+}
+
+status simplex_solver::try_suggest_value(const constraint& c, double x)
+{
+    if (!c.is_edit_constraint())
+        return status::edit_misuse;
+
     auto ei = std::find(edit_info_list_.rbegin(), edit_info_list_.rend(), c);
     if (ei == edit_info_list_.rend())
-        throw edit_misuse(e.var());
+        return status::edit_misuse;
+
+    bool lazy = parametric_ready();
+    if (!lazy)
+        flush_parametric();
 
     double delta{x - ei->prev_constant};
     ei->prev_constant = x;
-    delta_edit_constant(delta, ei->plus, ei->minus);
+    if (!lazy)
+        delta_edit_constant(delta, *ei);
 
+    return status::ok;
+}
+
+simplex_solver& simplex_solver::suggest_values(const variable* vars,
+                                               const double* values,
+                                               size_t count)
+{
+    if (try_suggest_values(vars, values, count) != status::ok) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!has_edit_var(vars[i]))
+                RHEA_THROW(edit_misuse(vars[i]));
+        }
+    }
     return *this;
 }
 
+status simplex_solver::try_suggest_values(const variable* vars,
+                                          const double* values, size_t count)
+{
+    suggested_.clear();
+    for (size_t i = 0; i < count; ++i)
+        suggested_[vars[i]] = suggested_value{values[i], false};
+
+    size_t found = 0;
+    for (auto& e : edit_info_list_) {
+        auto i = suggested_.find(e.v);
+        if (i != suggested_.end() && !i->second.found) {
+            i->second.found = true;
+            ++found;
+        }
+    }
+    if (found < suggested_.size())
+        return status::edit_misuse;
+
+    bool lazy = parametric_ready();
+    if (!lazy)
+        flush_parametric();
+
+    for (auto& e : edit_info_list_) {
+        auto i = suggested_.find(e.v);
+        if (i == suggested_.end())
+            continue;
+
+        double delta{i->second.value - e.prev_constant};
+        e.prev_constant = i->second.value;
+        if (delta != 0.0 && !lazy)
+            collect_edit_delta(delta, e.plus, e.minus);
+    }
+    apply_row_deltas();
+
+    return status::ok;
+}
+
 simplex_solver& simplex_solver::suggest(const variable& v, double x)
 {
+    if (has_edit_var(v)) {
+        suggest_value(v, x);
+        resolve();
+        return *this;
+    }
+
     add_edit_var(v);
     begin_edit();
     suggest_value(v, x);
@@ -362,11 +1495,42 @@ simplex_solver& simplex_solver::suggest(const variable& v, double x)
     return *this;
 }
 
+status simplex_solver::try_suggest(const variable& v, double x)
+{
+    if (has_edit_var(v)) {
+        try_suggest_value(v, x);
+        resolve();
+        return status::ok;
+    }
+
+    auto result = try_add_edit_var(v);
+    if (result != status::ok)
+        return result;
+
+    // These can't fail anymore now that v is an edit variable.
+    try_begin_edit();
+    try_suggest_value(v, x);
+    return try_end_edit();
+}
+
 simplex_solver&
 simplex_solver::suggest(const std::list<suggestion>& suggestions)
 {
-    for (auto& sugg : suggestions)
-        add_edit_var(sugg.v);
+    bool all_known = true;
+    for (auto& sugg : suggestions) {
+        if (!has_edit_var(sugg.v)) {
+            add_edit_var(sugg.v);
+            all_known = false;
+        }
+    }
+
+    if (all_known) {
+        for (auto& sugg : suggestions)
+            suggest_value(sugg.v, sugg.suggested_value);
+
+        resolve();
+        return *this;
+    }
 
     begin_edit();
     for (auto& sugg : suggestions)
@@ -378,12 +1542,91 @@ simplex_solver::suggest(const std::list<suggestion>& suggestions)
 
 simplex_solver& simplex_solver::solve()
 {
+    finish_resolve();
+    flush_parametric();
     if (needs_solving_)
         solve_();
 
     return *this;
 }
 
+status simplex_solver::solve_for(const strength& last)
+{
+    return solve_for(last, std::chrono::steady_clock::time_point::max());
+}
+
+status simplex_solver::solve_for(const strength& last,
+                                 std::chrono::steady_clock::duration limit)
+{
+    return solve_for(last, std::chrono::steady_clock::now() + limit);
+}
+
+status simplex_solver::solve_for(
+    const strength& last, std::chrono::steady_clock::time_point deadline)
+{
+    finish_resolve();
+    flush_parametric();
+    if (!needs_solving_)
+        return status::ok;
+
+    // The number of levels to optimize.  The tableau always satisfies
+    // the required constraints, so those need no work of their own.
+    const symbolic_weight& w = last.weight();
+    size_t levels = w.levels();
+    if (last.is_required())
+        levels = 0;
+    else if (w.level(0) != 0)
+        levels = 1;
+    else if (w.level(1) != 0)
+        levels = 2;
+
+    bool done = true;
+    for (size_t i = 0; i < levels && done; ++i)
+        done = optimize_level(i, deadline);
+
+    set_external_variables();
+    needs_solving_ = !done || levels < w.levels();
+
+    if (on_resolve)
+        on_resolve(*this);
+
+    return needs_solving_ ? status::partial : status::ok;
+}
+
+bool simplex_solver::optimize_level(
+    size_t level, std::chrono::steady_clock::time_point deadline)
+{
+    // With all levels, this is the usual objective.
+    if (level + 1 == symbolic_weight().levels())
+        return optimize(objective_, deadline);
+
+    // Otherwise, build an objective that has the same terms, with the
+    // weights of the weaker levels left out.  It only needs to live
+    // while it is being optimized.
+    linear_expression row;
+    for (auto& e : error_vars_) {
+        const symbolic_weight& w = e.first.get_symbolic_weight();
+        symbolic_weight part{w.level(0), level > 0 ? w.level(1) : 0, 0};
+        double coeff = part.as_double() * e.first.weight();
+        if (coeff == 0)
+            continue;
+
+        for (const variable& v : e.second) {
+            if (is_basic_var(v))
+                row += read_row(v) * coeff;
+            else
+                row += linear_expression::term(v, coeff);
+        }
+    }
+
+    variable z{std::make_shared<objective_variable>()};
+    add_row(z, row);
+    bool done = optimize(z, deadline);
+    remove_row(z);
+
+    return done;
+}
+
 void simplex_solver::solve_()
 {
     optimize(objective_);
@@ -394,8 +1637,8 @@ void simplex_solver::solve_()
         on_resolve(*this);
 }
 
-std::pair<bool, constraint_list>
-simplex_solver::add_with_artificial_variable(linear_expression& expr)
+bool simplex_solver::add_with_artificial_variable(
+    linear_expression& expr, constraint_list* explanation)
 {
     // The artificial objective is av, which we know is equal to expr
     // (which contains only parametric variables).
@@ -428,15 +1671,17 @@ simplex_solver::add_with_artificial_variable(linear_expression& expr)
     // Check that we were able to make the objective value 0
     // If not, the original constraint was not satisfiable
     if (!near_zero(tableau_row.constant())) {
-        constraint_list result;
-        if (explain_failure_)
-            result = build_explanation(az, tableau_row);
+        if (explanation)
+            *explanation = build_explanation(az, tableau_row);
 
-        return std::make_pair(false, result);
+        // The artificial objective is of no use anymore.  The row for av
+        // will disappear when the caller removes the constraint's marker.
+        remove_row(az);
+        return false;
     }
 
     if (is_basic_var(av)) {
-        const auto& e = row_expression(av);
+        const auto& e = read_row(av);
 
         // Find another variable in this row and Pivot, so that av becomes
         // parametric
@@ -445,15 +1690,15 @@ simplex_solver::add_with_artificial_variable(linear_expression& expr)
         if (e.is_constant()) {
             assert(near_zero(e.constant()));
             remove_row(av);
-            return {true, constraint_list()};
+            return true;
         }
         variable entry(e.find_pivotable_variable());
         if (entry.is_nil()) {
-            constraint_list result;
-            if (explain_failure_)
-                result = build_explanation(av, e);
+            if (explanation)
+                *explanation = build_explanation(av, e);
 
-            return {false, result};
+            remove_row(az);
+            return false;
         }
         pivot(entry, av);
     }
@@ -462,18 +1707,88 @@ simplex_solver::add_with_artificial_variable(linear_expression& expr)
     remove_column(av);
     remove_row(az);
 
-    return {true, constraint_list()};
+    return true;
 }
 
-simplex_solver& simplex_solver::remove_edit_vars_to(size_t n)
+bool simplex_solver::is_held(const variable& v) const
 {
-    while (edit_info_list_.size() > n) {
-        remove_edit_var(edit_info_list_.back().v);
+    auto i = std::find(edit_info_list_.begin(), edit_info_list_.end(), v);
+    while (i != edit_info_list_.end()) {
+        if (i->held)
+            return true;
+
+        i = std::find(std::next(i), edit_info_list_.end(), v);
     }
+    return false;
+}
+
+simplex_solver& simplex_solver::hold_edit_var(const variable& v,
+                                              const strength& s,
+                                              double weight)
+{
+    if (is_held(v))
+        return *this;
+
+    add_edit_var(v, s, weight);
+    edit_info_list_.back().held = true;
+    return *this;
+}
+
+status simplex_solver::try_hold_edit_var(const variable& v,
+                                         const strength& s, double weight)
+{
+    if (is_held(v))
+        return status::ok;
+
+    auto result = try_add_edit_var(v, s, weight);
+    if (result == status::ok)
+        edit_info_list_.back().held = true;
+
+    return result;
+}
+
+simplex_solver& simplex_solver::release_edit_vars()
+{
+    erase_edit_vars(0, [](const edit_info& e) { return e.held; });
+    return *this;
+}
+
+simplex_solver& simplex_solver::remove_edit_vars_to(size_t n)
+{
+    erase_edit_vars(n, [](const edit_info& e) { return !e.held; });
+    return *this;
+}
 
+simplex_solver& simplex_solver::remove_all_edit_vars()
+{
+    erase_edit_vars(0, [](const edit_info&) { return true; });
     return *this;
 }
 
+void simplex_solver::erase_edit_vars(
+    size_t n, std::function<bool(const edit_info&)> pred)
+{
+    finish_resolve();
+    flush_parametric();
+
+    // Take copies, erase_constraint() removes the edit_info.
+    constraint_list doomed;
+    auto i = edit_info_list_.rbegin();
+    for (size_t left = edit_info_list_.size(); left > n; --left, ++i) {
+        if (pred(*i))
+            doomed.push_back(i->c);
+    }
+    if (doomed.empty())
+        return;
+
+    reset_stay_constants();
+    for (auto& c : doomed)
+        erase_constraint(c);
+
+    if (auto_solve_)
+        solve_();
+}
+
 bool simplex_solver::try_adding_directly(linear_expression& expr)
 {
     variable subj{choose_subject(expr)};
@@ -489,14 +1804,22 @@ bool simplex_solver::try_adding_directly(linear_expression& expr)
 }
 
 simplex_solver& simplex_solver::remove_edit_var(const variable& v)
+{
+    if (try_remove_edit_var(v) != status::ok)
+        RHEA_THROW(edit_misuse(v));
+
+    return *this;
+}
+
+status simplex_solver::try_remove_edit_var(const variable& v)
 {
     auto i = std::find(edit_info_list_.rbegin(), edit_info_list_.rend(), v);
     if (i == edit_info_list_.rend())
-        throw edit_misuse(v);
-
-    remove_constraint(i->c);
+        return status::edit_misuse;
 
-    return *this;
+    // Take a copy, the edit_info will be gone after the removal.
+    constraint c{i->c};
+    return try_remove_constraint(c);
 }
 
 variable simplex_solver::choose_subject(linear_expression& expr)
@@ -527,9 +1850,9 @@ variable simplex_solver::choose_subject(linear_expression& expr)
                 // objective function when we make the Expression.  We also
                 // never pick a dummy variable here.
                 if (!found_new_restricted && !v.is_dummy() && c < 0.0) {
-                    auto i(columns_.find(v));
-                    if (i == columns_.end()
-                        || (columns_.size() == 1
+                    auto i(columns_->find(v));
+                    if (i == columns_->end()
+                        || (columns_->size() == 1
                             && columns_has_key(objective_))) {
                         subj = v;
                         found_new_restricted = true;
@@ -564,9 +1887,9 @@ variable simplex_solver::choose_subject(linear_expression& expr)
     // If we get this far, all of the variables in the expression should
     // be dummy variables.  If the constant is nonzero we are trying to
     // add an unsatisfiable required constraint.  (Remember that dummy
-    // variables must take on a value of 0.)
-    if (!near_zero(expr.constant()))
-        throw required_failure();
+    // variables must take on a value of 0.)  insert_constraint() has
+    // already rejected those.
+    assert(near_zero(expr.constant()));
 
     // Otherwise, if the constant is zero, multiply by -1 if necessary to
     // make the coefficient for the subject negative.
@@ -576,8 +1899,11 @@ variable simplex_solver::choose_subject(linear_expression& expr)
     return subj;
 }
 
-void simplex_solver::optimize(const variable& v)
+bool simplex_solver::optimize(const variable& v,
+                              std::chrono::steady_clock::time_point deadline)
 {
+    const bool timed
+        = deadline != std::chrono::steady_clock::time_point::max();
     std::less<variable> ord;
     auto& row = row_expression(v);
 
@@ -587,40 +1913,89 @@ void simplex_solver::optimize(const variable& v)
         // Find the most negative coefficient in the objective function
         // (ignoring the non-pivotable dummy variables).  If all
         // coefficients are positive we're done.
-        bool found_negative = false;
-        for (auto& p : row.terms()) {
-            const auto& var = p.first;
-            if (var.is_pivotable() && p.second < 0.0) {
-                entry = var;
-                found_negative = true;
-                break;
+        const auto& terms = row.terms();
+        auto is_entry = [&](size_t i) {
+            auto& p = *(terms.begin() + i);
+            return p.first.is_pivotable() && p.second < 0.0;
+        };
+        size_t first = terms.size();
+        if (is_parallel(terms.size())) {
+            // Every piece looks for the first candidate it has, unless
+            // an earlier piece has already found one.
+            std::atomic<size_t> found{terms.size()};
+            parallel_for(terms.size(), [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end && i < found; ++i) {
+                    if (is_entry(i)) {
+                        size_t f = found;
+                        while (i < f && !found.compare_exchange_weak(f, i))
+                            ;
+                        break;
+                    }
+                }
+            });
+            first = found;
+        } else {
+            for (size_t i = 0; i < terms.size(); ++i) {
+                if (is_entry(i)) {
+                    first = i;
+                    break;
+                }
             }
         }
+        bool found_negative = first < terms.size();
+        if (found_negative)
+            entry = (terms.begin() + first)->first;
 
         // If all coefficients were positive (or if the objective
         // function has no pivotable variables) we are at an optimum.
         if (!found_negative)
-            return;
+            return true;
+
+        if (timed && std::chrono::steady_clock::now() >= deadline)
+            return false;
 
         // Choose which variable to move out of the basis.
         // Only consider pivotable basic variables
         // (i.e. restricted, non-dummy variables).
         double min_ratio{std::numeric_limits<double>::max()};
-        double r = 0.0;
-        for (const variable& var : columns_[entry]) {
-            if (var.is_pivotable()) {
-                const auto& expr = row_expression(var);
-                double coeff = expr.coefficient(entry);
-
-                if (coeff >= 0) // Only consider negative coefficients
-                    continue;
-
-                r = -expr.constant() / coeff;
-                if (r < min_ratio || (approx(r, min_ratio) && ord(var, exit))) {
-                    min_ratio = r;
-                    exit = var;
-                }
+        const double none{std::numeric_limits<double>::quiet_NaN()};
+        auto ratio = [&](const variable& var) {
+            if (!var.is_pivotable())
+                return none;
+
+            const auto& expr = read_row(var);
+            double coeff = expr.coefficient(entry);
+
+            if (coeff >= 0) // Only consider negative coefficients
+                return none;
+
+            return -expr.constant() / coeff;
+        };
+        auto consider = [&](const variable& var, double r) {
+            if (std::isnan(r))
+                return;
+
+            if (r < min_ratio || (approx(r, min_ratio) && ord(var, exit))) {
+                min_ratio = r;
+                exit = var;
             }
+        };
+
+        const variable_set& column = *columns_->at(entry);
+        if (is_parallel(column.size())) {
+            // Work out the ratios on the thread pool, and pick one in
+            // the same order as below.
+            std::vector<variable> vars(column.begin(), column.end());
+            std::vector<double> ratios(vars.size());
+            parallel_for(vars.size(), [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i)
+                    ratios[i] = ratio(vars[i]);
+            });
+            for (size_t i = 0; i < vars.size(); ++i)
+                consider(vars[i], ratios[i]);
+        } else {
+            for (const variable& var : column)
+                consider(var, ratio(var));
         }
 
         // If minRatio is still nil at this point, it means that the
@@ -628,12 +2003,79 @@ void simplex_solver::optimize(const variable& v)
         // arbitrarily negative.  This should never happen in this
         // application.
         if (min_ratio == std::numeric_limits<double>::max())
-            throw internal_error("objective function is unbounded");
+            RHEA_THROW(internal_error("objective function is unbounded"));
 
         pivot(entry, exit);
     }
 }
 
+void simplex_solver::collect_edit_delta(double delta, const variable& plus,
+                                        const variable& minus)
+{
+    // Same as delta_edit_constant(), but the rows aren't changed yet.
+    if (is_basic_var(plus)) {
+        row_deltas_[plus] += delta;
+        return;
+    }
+    if (is_basic_var(minus)) {
+        row_deltas_[minus] -= delta;
+        return;
+    }
+
+    auto ic = columns_->find(minus);
+    if (ic == columns_->end())
+        return;
+
+    for (auto& v : *ic->second)
+        row_deltas_[v] += read_row(v).coefficient(minus) * delta;
+}
+
+void simplex_solver::apply_row_deltas()
+{
+    for (auto& d : row_deltas_) {
+        auto& expr = row_expression(d.first);
+        expr.increment_constant(d.second);
+
+        if (d.first.is_restricted() && expr.constant() < 0)
+            infeasible_rows_.insert(d.first);
+    }
+    row_deltas_.clear();
+}
+
+void simplex_solver::delta_edit_constant(double delta, edit_info& e)
+{
+    claim_rows();
+    if (!e.rows.empty() && e.rows_version == version()) {
+        for (auto& r : e.rows) {
+            r.expr->increment_constant(r.coeff * delta);
+            if (r.restricted && r.expr->constant() < 0)
+                infeasible_rows_.insert(r.v);
+        }
+        return;
+    }
+
+    delta_edit_constant(delta, e.plus, e.minus);
+
+    // If one of the error variables is basic, only a single row needs
+    // to be changed anyway.
+    e.rows.clear();
+    if (edit_hints_.count(e.v) == 0 || is_basic_var(e.plus)
+        || is_basic_var(e.minus)) {
+        return;
+    }
+
+    auto ic = columns_->find(e.minus);
+    if (ic == columns_->end())
+        return;
+
+    for (auto& v : *ic->second) {
+        auto& expr = row_expression(v);
+        e.rows.push_back(
+            edit_row{v, &expr, expr.coefficient(e.minus), v.is_restricted()});
+    }
+    e.rows_version = version();
+}
+
 void simplex_solver::delta_edit_constant(double delta, const variable& plus,
                                          const variable& minus)
 {
@@ -661,7 +2103,11 @@ void simplex_solver::delta_edit_constant(double delta, const variable& plus,
     // (it doesn't matter whether we look for that one or for
     // plusErrorVar).  Fix the constants in these expressions.
 
-    for (auto& v : columns_[minus]) {
+    auto ic = columns_->find(minus);
+    if (ic == columns_->end())
+        return;
+
+    for (auto& v : *ic->second) {
         auto& expr(row_expression(v));
         expr.increment_constant(expr.coefficient(minus) * delta);
 
@@ -670,8 +2116,12 @@ void simplex_solver::delta_edit_constant(double delta, const variable& plus,
     }
 }
 
-void simplex_solver::dual_optimize()
+bool simplex_solver::dual_optimize(
+    size_t max_pivots, std::chrono::steady_clock::time_point deadline)
 {
+    const bool timed
+        = deadline != std::chrono::steady_clock::time_point::max();
+    size_t pivots = 0;
     auto& row = row_expression(objective_);
     while (!infeasible_rows_.empty()) {
         auto ii = infeasible_rows_.begin();
@@ -687,27 +2137,50 @@ void simplex_solver::dual_optimize()
         if (expr.constant() >= 0)
             continue; // Skip this row if it's feasible.
 
+        if (pivots == max_pivots
+            || (timed && std::chrono::steady_clock::now() >= deadline)) {
+            infeasible_rows_.insert(exit_var);
+            return false;
+        }
+
         double ratio = std::numeric_limits<double>::max();
-        double r = 0.0;
         variable entry_var{variable::nil_var()};
 
-        for (auto& p : expr.terms()) {
-            const variable& v = p.first;
-            double c = p.second;
-            if (c > 0 && v.is_pivotable()) {
-                r = row.coefficient(v) / c;
-                if (r < ratio) {
-                    entry_var = v;
-                    ratio = r;
-                }
+        const double none{std::numeric_limits<double>::quiet_NaN()};
+        auto candidate = [&](const linear_expression::term& p) {
+            if (p.second > 0 && p.first.is_pivotable())
+                return row.coefficient(p.first) / p.second;
+
+            return none;
+        };
+        auto consider = [&](const variable& v, double r) {
+            if (r < ratio) {
+                entry_var = v;
+                ratio = r;
             }
+        };
+
+        const auto& terms = expr.terms();
+        if (is_parallel(terms.size())) {
+            std::vector<double> ratios(terms.size());
+            parallel_for(terms.size(), [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i)
+                    ratios[i] = candidate(*(terms.begin() + i));
+            });
+            for (size_t i = 0; i < terms.size(); ++i)
+                consider((terms.begin() + i)->first, ratios[i]);
+        } else {
+            for (auto& p : terms)
+                consider(p.first, candidate(p));
         }
 
         if (ratio == std::numeric_limits<double>::max())
-            throw internal_error("dual_optimize: no pivot found");
+            RHEA_THROW(internal_error("dual_optimize: no pivot found"));
 
         pivot(entry_var, exit_var);
+        ++pivots;
     }
+    return true;
 }
 
 void simplex_solver::pivot(const variable& entry, const variable& exit)
@@ -736,6 +2209,8 @@ void simplex_solver::pivot(const variable& entry, const variable& exit)
 
 void simplex_solver::reset_stay_constants()
 {
+    flush_parametric();
+
     auto ip = stay_plus_error_vars_.begin();
     auto im = stay_minus_error_vars_.begin();
 
@@ -762,15 +2237,18 @@ void simplex_solver::set_external_variables()
 
     // Only iterate over the rows w/ external variables
     for (variable v : external_rows_)
-        change(v, row_expression(v).constant());
+        change(v, read_row(v).constant());
 
     needs_solving_ = false;
 }
 
 bool simplex_solver::is_constraint_satisfied(const constraint& c) const
 {
+    if (is_redundant(c))
+        return true;
+
     if (marker_vars_.count(c) == 0)
-        throw constraint_not_found();
+        RHEA_THROW(constraint_not_found());
 
     auto ie = error_vars_.find(c);
     if (ie != error_vars_.end()) {
@@ -778,7 +2256,7 @@ bool simplex_solver::is_constraint_satisfied(const constraint& c) const
             if (is_parametric_var(v))
                 continue;
 
-            if (!near_zero(row_expression(v).constant()))
+            if (!near_zero(read_row(v).constant()))
                 return false;
         }
     }
@@ -789,6 +2267,13 @@ void simplex_solver::change_strength_and_weight(constraint c,
                                                 const strength& s,
                                                 double weight)
 {
+    if (frozen_ && frozen_->count(c) > 0)
+        RHEA_THROW(shared_constraint());
+
+    finish_resolve();
+    flush_parametric();
+    clear_basis_cache();
+
     auto ie = error_vars_.find(c);
     if (ie == error_vars_.end())
         return;
@@ -807,11 +2292,12 @@ void simplex_solver::change_strength_and_weight(constraint c,
             row.add(v, -old_coeff, objective_, *this);
             row.add(v, new_coeff, objective_, *this);
         } else {
-            const linear_expression& expr(row_expression(v));
+            const linear_expression& expr(read_row(v));
             row.add(expr * -old_coeff, objective_, *this);
             row.add(expr * new_coeff, objective_, *this);
         }
     }
+    ++version_;
     needs_solving_ = true;
 
     if (auto_solve_)
@@ -829,27 +2315,44 @@ void simplex_solver::change_weight(constraint c, double weight)
 }
 
 simplex_solver& simplex_solver::begin_edit()
+{
+    if (try_begin_edit() != status::ok)
+        RHEA_THROW(edit_misuse());
+
+    return *this;
+}
+
+status simplex_solver::try_begin_edit()
 {
     if (edit_info_list_.empty())
-        throw edit_misuse();
+        return status::edit_misuse;
 
+    finish_resolve();
     infeasible_rows_.clear();
     reset_stay_constants();
     cedcns_.push(edit_info_list_.size());
 
-    return *this;
+    return status::ok;
 }
 
 simplex_solver& simplex_solver::end_edit()
+{
+    if (try_end_edit() != status::ok)
+        RHEA_THROW(edit_misuse());
+
+    return *this;
+}
+
+status simplex_solver::try_end_edit()
 {
     if (edit_info_list_.empty())
-        throw edit_misuse();
+        return status::edit_misuse;
 
     resolve();
     cedcns_.pop();
     remove_edit_vars_to(cedcns_.top());
 
-    return *this;
+    return status::ok;
 }
 
 constraint_list
@@ -6,9 +6,16 @@
 //---------------------------------------------------------------------------
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
+#include <limits>
 #include <list>
+#include <memory>
 #include <stack>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "edit_constraint.hpp"
@@ -25,6 +32,8 @@ namespace rhea
 /** Solver that implements the Cassowary incremental simplex algorithm. */
 class simplex_solver : public solver, public tableau
 {
+    friend class constraint_model;
+
 public:
     typedef std::function<void(simplex_solver&)> event_cb;
     typedef std::function<void(const variable&, simplex_solver&)> variable_cb;
@@ -58,6 +67,64 @@ public:
         return *this;
     }
 
+    /** Add an edit constraint that stays in place between edits.
+     * Unlike the edit variables added with add_edit_var(), a held edit
+     * variable is not removed by end_edit(), and suggest() reuses it
+     * instead of adding and removing an edit constraint of its own.  This
+     * keeps suggesting a new value on every frame of a drag or a resize
+     * cheap.  Holding a variable that is already held does nothing.
+     * \sa release_edit_vars() */
+    simplex_solver& hold_edit_var(const variable& v,
+                                  const strength& s = strength::strong(),
+                                  double weight = 1.0);
+
+    /** Remove all held edit variables at once.
+     * This is meant to be called when a gesture ends.  The tableau is
+     * only solved once, no matter how many variables were held. */
+    simplex_solver& release_edit_vars();
+
+    /** Check if a variable has an edit constraint. */
+    bool has_edit_var(const variable& v) const
+    {
+        return std::find(edit_info_list_.begin(), edit_info_list_.end(), v)
+               != edit_info_list_.end();
+    }
+
+    /** Check if any variable has an edit constraint. */
+    bool has_edit_vars() const { return !edit_info_list_.empty(); }
+
+    /** The value that was last suggested for an edit variable.
+     * This is not always the value of the variable itself: the
+     * suggestion might not have been resolved yet, or the variable might
+     * not be able to follow it.
+     * \throws edit_misuse if \a v is not an edit variable */
+    double edit_value(const variable& v) const;
+
+    /** Tell the solver that a variable is likely to be edited often.
+     * When the error variables of a hinted edit variable are parametric,
+     * suggest_value() has to update every row they appear in.  For
+     * hinted variables, the solver keeps a list of those rows and their
+     * coefficients, which stays valid as long as the structure of the
+     * tableau doesn't change.  This suits variables like a window width
+     * or a splitter position, that get a new value on every frame of a
+     * gesture. */
+    simplex_solver& hint_edit_var(const variable& v)
+    {
+        edit_hints_.insert(v);
+        return *this;
+    }
+
+    simplex_solver& remove_edit_hint(const variable& v)
+    {
+        edit_hints_.erase(v);
+        return *this;
+    }
+
+    bool is_edit_hint(const variable& v) const
+    {
+        return edit_hints_.count(v) > 0;
+    }
+
     /** Begin suggesting new values for edit variables.
      * The application should call add_edit_var() first for every variable
      * it is planning to call suggest_value() for. In most cases, it is
@@ -69,12 +136,162 @@ public:
 
     simplex_solver& remove_edit_var(const variable& v);
 
+    /** Remove the edit variables that were added after the first \a n,
+     ** except for the held ones. */
     simplex_solver& remove_edit_vars_to(size_t n);
 
-    simplex_solver& remove_all_edit_vars() { return remove_edit_vars_to(0); }
+    /** Remove all edit variables, including the held ones. */
+    simplex_solver& remove_all_edit_vars();
 
     void resolve();
 
+    /** Resolve, but stop after a number of pivots.
+     * Heavy changes can take a lot of pivots to resolve.  This spreads
+     * them over several calls, for instance one per frame.  If the
+     * budget runs out, the tableau is left in the same state as after
+     * suggest_value(): it is consistent, and the next call to
+     * resolve_for() or resolve() continues where this one stopped.
+     * Until then, the variables keep the values of the last complete
+     * solution, since the solution in progress is not feasible.  New
+     * values can be suggested in between.
+     * \param max_pivots  The number of pivots that can be done
+     * \return status::ok if the solver is done, or status::partial */
+    status resolve_for(size_t max_pivots);
+
+    /** Resolve, but stop when a time limit has passed.
+     * The time is checked before every pivot, so a single pivot can
+     * still run over.
+     * \sa resolve_for(size_t) */
+    status resolve_for(std::chrono::steady_clock::duration limit);
+
+    /** Calculate the solutions for a sequence of values of an edit
+     ** variable.
+     * This does the same as calling suggest_value() and resolve() for
+     * every value, except that the variables are only updated (and their
+     * callbacks only invoked) once, for the last value.  Consecutive
+     * values that are close together usually share a basis, so a sorted
+     * sequence is the cheapest to solve, especially in parametric mode.
+     * \param v        The edit variable
+     * \param values   The values to suggest for \a v, in order
+     * \param outputs  The variables to report
+     * \return A row-major matrix with a row for every value, and a column
+     *         for every variable in \a outputs */
+    std::vector<double> solve_trajectory(const variable& v,
+                                         const std::vector<double>& values,
+                                         const std::vector<variable>& outputs);
+
+    /** Calculate the solutions for several independent sets of values
+     ** of some edit variables.
+     * Every scenario is solved as if it was the only one suggested, so
+     * the result does not depend on their order, and the solver is left
+     * as it was.  Scenarios that end up in the same basis are calculated
+     * together from its parametric map, which is much faster than
+     * solving them one by one; only a scenario that is outside every
+     * basis seen so far is passed through the simplex method.
+     * \param edits    The edit variables
+     * \param values   A row-major matrix with a row for every scenario,
+     *                 and a column for every variable in \a edits
+     * \param outputs  The variables to report
+     * \return A row-major matrix with a row for every scenario, and a
+     *         column for every variable in \a outputs
+     * \throws edit_misuse if one of \a edits is not an edit variable, or
+     *         if \a values doesn't have a column for each of them */
+    std::vector<double> solve_scenarios(const std::vector<variable>& edits,
+                                        const std::vector<double>& values,
+                                        const std::vector<variable>& outputs);
+
+    /** Switch parametric resolving on or off.
+     * As long as the basis of the tableau stays feasible, the values of
+     * the variables are affine functions of the edit constants.  In
+     * parametric mode, resolve() keeps this map around after it has
+     * optimized the tableau.  The next resolve() then only multiplies the
+     * changes in the edit constants with it, and checks if the basis is
+     * still feasible (and therefore still optimal).  The tableau is only
+     * optimized again once the edit constants leave that range.  This
+     * makes the frames of a typical drag or resize a lot cheaper.
+     * suggest_value() doesn't touch the tableau at all while the map is
+     * valid. */
+    simplex_solver& set_parametric(bool on = true)
+    {
+        parametric_ = on;
+        if (!on)
+            flush_parametric();
+
+        return *this;
+    }
+
+    bool is_parametric() const { return parametric_; }
+
+    /** The range of values for an edit variable over which the current
+     ** basis stays optimal.
+     * The other edit variables are assumed to keep their current
+     * suggested values.  This is only known in parametric mode, after
+     * resolve() has been called.
+     * \return The lower and upper bound of the range, or an empty range
+     *         (lower > upper) if it is not known */
+    std::pair<double, double> parametric_range(const variable& v) const;
+
+    /** The solution in the current basis, as an affine function of the
+     ** values of some edit variables. */
+    struct affine_region
+    {
+        /** One row for every output variable: the constant term,
+         ** followed by a coefficient for every edit variable. */
+        std::vector<double> values;
+
+        /** The rows of the inequalities that describe where the basis
+         ** stays feasible, in the same layout.  The region consists of
+         ** the points where every row is non-negative. */
+        std::vector<double> bounds;
+
+        /** Find out which of a number of points lie outside the region.
+         * \param in         The points, one edit variable at a time: the
+         *                   first value of every point, then the second
+         *                   value of every point, and so on
+         * \param edits      The number of edit variables
+         * \param count      The number of points
+         * \param inside     Set to zero for the points outside the region,
+         *                   left alone for the others
+         * \param scratch    Room for \a count values
+         * \param tolerance  How far a point may be outside the region, to
+         *                   allow for rounding errors */
+        void clip(const double* in, size_t edits, size_t count,
+                  char* inside, double* scratch,
+                  double tolerance = 1.0e-8) const;
+    };
+
+    /** Describe the current basis as an affine region.
+     * Edit variables that are not in \a edits are assumed to keep their
+     * current suggested values.  Like parametric_range(), this is only
+     * known in parametric mode, after resolve() has been called.
+     * \param edits    The edit variables that span the region
+     * \param outputs  The variables to describe
+     * \param result   Receives the region
+     * \return False iff the region is not known */
+    bool parametric_region(const std::vector<variable>& edits,
+                           const std::vector<variable>& outputs,
+                           affine_region& result) const;
+
+    /** Keep recently optimal bases around, to jump back to them.
+     * When a suggested value makes the current basis infeasible,
+     * resolve() first tries the cached bases, most recently used first.
+     * The constants of a cached basis are recalculated for the current
+     * edit and stay constants; if it turns out to be feasible, it is
+     * optimal as well, and is used without any pivoting.  This pays off
+     * if the edit variables go back and forth between a few places, such
+     * as the breakpoints of a layout.
+     * The cache is emptied whenever a constraint is added or removed,
+     * so use hold_edit_var() to keep the edit constraints in place.
+     * \param bytes  The (estimated) amount of memory the cache may use;
+     *               0 switches the cache off */
+    simplex_solver& set_basis_cache(size_t bytes);
+
+    size_t basis_cache_size() const { return basis_cache_.size(); }
+    size_t basis_cache_hits() const { return basis_cache_hits_; }
+    size_t basis_cache_misses() const { return basis_cache_misses_; }
+
+    void clear_basis_cache();
+
     /** Suggest a new value for an edit variable.
      *  The variable needs to be added as an edit variable,
      *  and begin_edit() needs to be called first.
@@ -88,9 +305,32 @@ public:
      *  completely until resolve() or end_edit() has been called. */
     simplex_solver& suggest_value(const constraint& v, double x);
 
+    /** Suggest new values for a number of edit variables at once.
+     *  This does the same as calling suggest_value() for every variable,
+     *  but a row that depends on several of the edit variables only has
+     *  its constant updated once.  If one of the variables is not an edit
+     *  variable, nothing is changed and edit_misuse is thrown.
+     * \param vars    The edit variables
+     * \param values  The suggested values, in the same order as \a vars
+     * \param count   The number of variables and values */
+    simplex_solver& suggest_values(const variable* vars, const double* values,
+                                   size_t count);
+
+    /** \sa suggest_values(const variable*, const double*, size_t)
+     * \throws edit_misuse if \a vars and \a values differ in size */
+    simplex_solver& suggest_values(const std::vector<variable>& vars,
+                                   const std::vector<double>& values)
+    {
+        if (vars.size() != values.size())
+            RHEA_THROW(edit_misuse());
+
+        return suggest_values(vars.data(), values.data(), vars.size());
+    }
+
     /** Suggest a new value for a variables.
      *  This function calls add_edit_variable(), begin_edit(), and
-     *  end_edit() as well.
+     *  end_edit() as well.  If \a v already is an edit variable, its
+     *  value is suggested and the tableau is resolved right away.
      * \code
      solver.suggest(width, 200);
      * \endcode */
@@ -98,7 +338,8 @@ public:
 
     /** Suggest new values for a list of variables.
      *  This function calls add_edit_variable(), begin_edit(), and
-     *  end_edit() as well.
+     *  end_edit() as well, for the variables that aren't edit variables
+     *  yet.
      * \code
      solver.suggest({{ width, 200 }, { height, 150 }});
      * \endcode */
@@ -108,10 +349,31 @@ public:
      ** call this function before accessing variables values. */
     simplex_solver& solve();
 
+    /** Solve one strength level at a time, and stop after a given
+     ** level.
+     * First the strong constraints are optimized, then the medium ones,
+     * and then the weak ones.  The values of the variables are updated
+     * after every level, so they can be shown while the weaker levels
+     * are still to be done.  A later solve() or solve_for() picks up
+     * from there.  This is only useful with autosolving turned off.
+     * \param last  strength::required() to only make the values
+     *              feasible, strength::strong(), medium(), or weak()
+     * \return status::ok if all levels are done, or status::partial */
+    status solve_for(const strength& last);
+
+    /** Solve one strength level at a time, until a time limit has
+     ** passed.
+     * Every step of the optimization keeps the required constraints
+     * satisfied, so when the time runs out halfway through a level,
+     * the values so far are still published.
+     * \sa solve_for(const strength&) */
+    status solve_for(const strength& last,
+                     std::chrono::steady_clock::duration limit);
+
     /** Check if the solver knows of a given variable.
      * \param v The variable to check for
      * \return True iff v is a column in the tableau or a basic variable */
-    bool contains_variable(const variable& v)
+    bool contains_variable(const variable& v) const
     {
         return columns_has_key(v) || is_basic_var(v);
     }
@@ -119,9 +381,21 @@ public:
     /** Check if the solver knows of a given constraint.
      * \param c The constraint to check for
      * \return True iff c has been added to the solver */
-    bool contains_constraint(const constraint& c)
+    bool contains_constraint(const constraint& c) const
+    {
+        return marker_vars_.find(c) != marker_vars_.end()
+               || shared_rows_.count(c) > 0 || is_implied(c);
+    }
+
+    /** Check if a constraint was accepted without a row of its own.
+     * Required constraints that are duplicates of a constraint in the
+     * tableau, or that are implied by the required equalities in the
+     * tableau, do not get a row, marker, or error variables.
+     * \param c The constraint to check for
+     * \return True iff c shares the row of another constraint */
+    bool is_redundant(const constraint& c) const
     {
-        return marker_vars_.find(c) != marker_vars_.end();
+        return shared_rows_.count(c) > 0 || is_implied(c);
     }
 
     /** Check if this constraint was satisfied. */
@@ -130,8 +404,76 @@ public:
     /** Reset all external variables to their current values.
      * Note: this triggers all callbacks, which might be used to copy the
      * variable's value to another variable. */
-    void update_external_variables() { set_external_variables(); }
+    void update_external_variables()
+    {
+        flush_parametric();
+        set_external_variables();
+    }
+
+    /** Release the memory that is no longer needed after removing a
+     ** large number of constraints. \sa tableau::shrink_to_fit() */
+    void shrink_to_fit();
+
+    /** Replace external variables by others.
+     * The tableau stays as it is, but the solution is written to the
+     * new variables from now on.  This is how constraint_model hands out
+     * instances.  The constraints that were added with the old variables
+     * are still known by their original handles, so they can be removed
+     * again.
+     * \param from  The variables to replace; none of them may be edit
+     *              variables
+     * \param to    The replacements, in the same order
+     * \throws edit_misuse if one of \a from is an edit variable, or if
+     *         \a from and \a to differ in size */
+    void replace_variables(const std::vector<variable>& from,
+                           const std::vector<variable>& to);
 
+    /** Make a copy of this solver to try out some changes.
+     * The clone shares the rows and columns of the tableau with this
+     * solver, and only copies the ones it changes.  (The lists of
+     * constraints and error variables are still copied.)  It doesn't
+     * write to the variables or call any callbacks, so it can be
+     * changed and solved without disturbing this solver; read the
+     * results with solution_value().  Making a clone doesn't change
+     * this solver, so several threads can clone it at once, as long as
+     * none of them changes it. */
+    simplex_solver clone() const;
+
+    /** Start a transaction.
+     * Everything that is done to the solver from now on can be undone
+     * at once with rollback().  Transactions can be nested.
+     *
+     * This takes a snapshot rather than keeping an undo log: the solver
+     * keeps a copy of itself, which shares the rows and columns of the
+     * tableau until they are changed.  Starting a transaction copies
+     * the bookkeeping of the solver (its constraints, markers, and error
+     * variables), and the first change after that copies the index of
+     * the rows and columns, but not the rows themselves.  Only the rows
+     * and columns that are changed get copied. */
+    simplex_solver& begin_transaction();
+
+    /** Keep the changes made since the last begin_transaction(). */
+    simplex_solver& commit();
+
+    /** Undo the changes made since the last begin_transaction().
+     * The snapshot is put back in place, so the tableau is as it was
+     * without pivoting or optimizing, and the variables get their old
+     * values back.  The callbacks are kept. */
+    simplex_solver& rollback();
+
+    bool in_transaction() const { return !transactions_.empty(); }
+
+    /** Check if this solver is a clone made by clone(). */
+    bool is_speculative() const { return speculative_; }
+
+    /** The value of a variable in the current solution of the tableau.
+     * Unlike variable::value(), this is also up to date if the external
+     * variables haven't been set yet, and it works for clones. */
+    double solution_value(const variable& v) const;
+
+    /** Change the strength and weight of a constraint in the solver.
+     * \throws shared_constraint if \a c came from a constraint_model,
+     *         since the other instances of the model use it as well */
     void change_strength_and_weight(constraint c, const strength& s,
                                     double weight);
     void change_strength(constraint c, const strength& s);
@@ -172,10 +514,97 @@ public:
 
     bool is_explaining() const { return explain_failure_; }
 
+    /** \name Non-throwing interface
+     * These functions do the same as their counterparts without the
+     * \c try_ prefix, but report errors by returning a status code
+     * instead of throwing an exception.  If a function fails, the
+     * solver keeps the constraints and edit variables it had.  They can
+     * be used if the library is built without exception support. */
+    ///@{
+
+    /** Add a constraint to the solver.
+     * \param c            The constraint to add
+     * \param explanation  If not null, and \a c is a required constraint
+     *                     that cannot be satisfied, this receives the
+     *                     constraints that are responsible for the
+     *                     failure.  The list is only built if asked for.
+     * If \a c is a required constraint that was taken out again after
+     * the tableau had been pivoted to look for a solution, the solver is
+     * solved again (if auto_solve is on), just like after a removal.
+     * \return status::ok, status::required_failure, or
+     *         status::edit_misuse if an edit constraint was given for an
+     *         internal variable */
+    status try_add_constraint(const constraint& c,
+                              constraint_list* explanation = nullptr);
+
+    /** Remove a constraint from the solver.
+     * \return status::ok or status::constraint_not_found */
+    status try_remove_constraint(const constraint& c);
+
+    /** \sa add_edit_var() */
+    status try_add_edit_var(const variable& v,
+                            const strength& s = strength::strong(),
+                            double weight = 1.0)
+    {
+        return try_add_constraint(
+            std::make_shared<edit_constraint>(v, s, weight));
+    }
+
+    /** \sa hold_edit_var()
+     * \return status::ok, or the status of try_add_edit_var() */
+    status try_hold_edit_var(const variable& v,
+                             const strength& s = strength::strong(),
+                             double weight = 1.0);
+
+    /** \return status::ok or status::edit_misuse */
+    status try_remove_edit_var(const variable& v);
+
+    /** \return status::ok or status::edit_misuse */
+    status try_begin_edit();
+
+    /** \return status::ok or status::edit_misuse */
+    status try_end_edit();
+
+    /** \return status::ok or status::edit_misuse */
+    status try_suggest_value(const variable& v, double x);
+
+    /** \return status::ok or status::edit_misuse */
+    status try_suggest_value(const constraint& c, double x);
+
+    /** \return status::ok or status::edit_misuse */
+    status try_suggest_values(const variable* vars, const double* values,
+                              size_t count);
+
+    /** \return status::ok or status::edit_misuse, also if \a vars and
+     *         \a values differ in size */
+    status try_suggest_values(const std::vector<variable>& vars,
+                              const std::vector<double>& values)
+    {
+        if (vars.size() != values.size())
+            return status::edit_misuse;
+
+        return try_suggest_values(vars.data(), values.data(), vars.size());
+    }
+
+    /** \sa suggest() */
+    status try_suggest(const variable& v, double x);
+
+    ///@}
+
 protected:
     solver& add_constraint_(const constraint& c);
     solver& remove_constraint_(const constraint& c);
 
+    /** A row that depends on the error variables of an edit constraint.
+     ** \sa hint_edit_var() */
+    struct edit_row
+    {
+        variable v;
+        linear_expression* expr;
+        double coeff;
+        bool restricted;
+    };
+
     /** This is a privately-used struct that bundles a constraint, its
      ** positive and negative error variables, and its prior edit constant.
      */
@@ -188,6 +617,8 @@ protected:
             , plus{plus_}
             , minus{minus_}
             , prev_constant{prev_constant_}
+            , held{false}
+            , rows_version{0}
         {
         }
 
@@ -199,6 +630,13 @@ protected:
         variable plus;
         variable minus;
         double prev_constant;
+        bool held;
+
+        // The rows to update when the edit constant changes, for hinted
+        // edit variables.  Only valid if the tableau is still at version
+        // rows_version.
+        std::vector<edit_row> rows;
+        size_t rows_version;
     };
 
     /** Bundles an expression, a plus and minus slack variable, and a
@@ -219,12 +657,16 @@ protected:
         }
     };
 
-    /** Make a new linear expression representing the constraint c,
-     ** replacing any basic variables with their defining expressions.
+    /** Make a new linear expression representing the constraint c.
      * Normalize if necessary so that the constant is non-negative.  If
      * the constraint is non-required, give its error variables an
-     * appropriate weight in the objective function. */
-    expression_result make_expression(const constraint& c);
+     * appropriate weight in the objective function.
+     * \param c        The constraint
+     * \param reduced  The expression of c, with any basic variables
+     *                 replaced by their defining expressions
+     *                 \sa reduce() */
+    expression_result make_expression(const constraint& c,
+                                      const linear_expression& reduced);
 
     /** Add the constraint \f$expr = 0\f$ to the inequality tableau using
      ** an artificial variable.
@@ -232,10 +674,12 @@ protected:
      * expression \f$a_0 = expr\f$ to the inequality tableau.
      * Then we try to solve for \f$a_0 = 0\f$, the return value indicates
      * whether this has succeeded or not.
-     * @return True iff the expression could be added.
-     *         False and a list of the constraints involved if not */
-    std::pair<bool, constraint_list>
-    add_with_artificial_variable(linear_expression& expr);
+     * \param expr         The expression to add
+     * \param explanation  If not null, this receives the constraints
+     *                     involved if the expression could not be added
+     * @return True iff the expression could be added */
+    bool add_with_artificial_variable(linear_expression& expr,
+                                      constraint_list* explanation);
 
     /** Add the constraint \f$expr = 0\f$ to the inequality tableau.
      * @return True iff the expression could be added */
@@ -263,16 +707,50 @@ protected:
      * \return An appropriate subject, or nil */
     variable choose_subject(linear_expression& expr);
 
+    /** Add the change of the rows' constants that follows from changing
+     ** an edit constant by \a delta to row_deltas_.
+     * \sa delta_edit_constant() */
+    void collect_edit_delta(double delta, const variable& plus,
+                            const variable& minus);
+
+    /** Apply and clear the changes collected in row_deltas_. */
+    void apply_row_deltas();
+
+    /** Change the constant of an edit constraint, and update the rows
+     ** that depend on it.  Uses the cached rows of hinted edit
+     ** variables. */
+    void delta_edit_constant(double delta, edit_info& e);
+
     void delta_edit_constant(double delta, const variable& v1,
                              const variable& v2);
 
-    /** Optimize using the dual algorithm. */
-    void dual_optimize();
+    /** Optimize using the dual algorithm.
+     * \param max_pivots  Stop after this many pivots
+     * \param deadline    Stop when this time has passed
+     * \return False iff it stopped before the tableau was feasible */
+    bool dual_optimize(
+        size_t max_pivots = std::numeric_limits<size_t>::max(),
+        std::chrono::steady_clock::time_point deadline
+        = std::chrono::steady_clock::time_point::max());
 
     /** Minimize the value of an objective.
      * \pre The tableau is feasible.
-     * \param z The objective to optimize for */
-    void optimize(const variable& z);
+     * \param z         The objective to optimize for
+     * \param deadline  Stop when this time has passed
+     * \return False iff it stopped before the optimum was found */
+    bool optimize(const variable& z,
+                  std::chrono::steady_clock::time_point deadline
+                  = std::chrono::steady_clock::time_point::max());
+
+    /** Minimize the errors of the constraints, counting only the
+     ** strength levels up to and including \a level.
+     * \sa solve_for() */
+    bool optimize_level(size_t level,
+                        std::chrono::steady_clock::time_point deadline);
+
+    /** \sa solve_for() */
+    status solve_for(const strength& last,
+                     std::chrono::steady_clock::time_point deadline);
 
     /** Perform a pivot operation.
      *  Move entry into the basis (i.e. make it a basic variable), and move
@@ -291,9 +769,57 @@ protected:
 
     void solve_();
 
+    /** Check if the parametric map can be used for the next resolve(). */
+    bool parametric_ready() const
+    {
+        return parametric_ && pmap_.valid && pmap_.version == version();
+    }
+
+    /** Resolve the tableau after new values have been suggested.
+     * \param update_externals  Copy the solution to the external
+     *                          variables */
+    void resolve_(bool update_externals);
+
+    /** resolve_(), with a budget for the dual optimization.
+     * \return False iff the budget ran out \sa resolve_for() */
+    bool resolve_(bool update_externals, size_t max_pivots,
+                  std::chrono::steady_clock::time_point deadline);
+
+    /** Finish a resolve_for() that ran out of budget.
+     * This needs to be done before the constraints or the edit variables
+     * change, since the tableau is not feasible until then. */
+    void finish_resolve()
+    {
+        if (resolving_)
+            resolve_(true);
+    }
+
+    /** Resolve using the parametric map.
+     * \return False iff the edit constants have left the range in which
+     *         the map is valid, in which case nothing is changed */
+    bool parametric_resolve(bool update_externals);
+
+    /** Build the parametric map for the current basis. */
+    void build_parametric_map();
+
+    /** Store the current basis in the basis cache, unless it's in there
+     ** already. */
+    void cache_basis();
+
+    /** Switch to a cached basis that is feasible for the current
+     ** constants.
+     * \return True iff such a basis was found */
+    bool restore_cached_basis();
+
+    /** Apply the edit constants that were suggested while the parametric
+     ** map was valid to the tableau, and drop the map.
+     * This needs to be done before anything else reads or changes the
+     * tableau. */
+    void flush_parametric();
+
     void change(variable& v, double n)
     {
-        if (n != v.value()) {
+        if (!speculative_ && n != v.value()) {
             v.change_value(n);
             if (on_variable_change)
                 on_variable_change(v, *this);
@@ -303,6 +829,57 @@ protected:
     constraint_list build_explanation(const variable& v,
                                       const linear_expression& expr) const;
 
+    /** Replace all basic variables in \a expr with their rows. */
+    linear_expression reduce(const linear_expression& expr) const;
+
+    /** Try to accept a required constraint without adding a row.
+     * This succeeds if \a c is a duplicate of a required constraint that
+     * is already in the tableau, or if its reduced expression \a expr
+     * only consists of the dummy markers of required equalities.
+     * \return True iff c was accepted as redundant */
+    bool share_row(const constraint& c, const linear_expression& expr);
+
+    /** Undo share_row(), or hand over a row to one of its duplicates.
+     * \return True iff the tableau does not need to be changed */
+    bool unshare_row(const constraint& c);
+
+    /** Add a constraint to the tableau, without solving it.
+     * If this fails, the constraint is taken out again, but the stay
+     * constants are left alone.  \sa try_add_constraint() */
+    status insert_constraint(const constraint& c,
+                             constraint_list* explanation);
+
+    /** Take the row, marker, and error variables of a constraint out of
+     ** the tableau, without solving it. */
+    void erase_constraint(const constraint& c);
+
+    /** Check if a variable has a held edit constraint. */
+    bool is_held(const variable& v) const;
+
+    /** Remove the edit constraints from position \a n onwards that match
+     ** a predicate, and solve the tableau once afterwards. */
+    void erase_edit_vars(size_t n,
+                         std::function<bool(const edit_info&)> pred);
+
+    /** Check a required constraint against the bounds that are known
+     ** for its variables, without touching the tableau.
+     * \return True iff the constraint can never be satisfied */
+    bool violates_bounds(const constraint& c) const;
+
+    /** The constraints responsible for the bounds used by
+     ** violates_bounds(). */
+    constraint_list bounds_explanation(const constraint& c) const;
+
+    /** Keep track of the bounds set by a required constraint on a
+     ** single variable. */
+    void register_bounds(const constraint& c);
+    void unregister_bounds(const constraint& c);
+
+    bool is_implied(const constraint& c) const
+    {
+        return implied_.count(c) > 0;
+    }
+
 private:
     typedef std::unordered_map<constraint, variable_set>
         constraint_to_varset_map;
@@ -325,10 +902,114 @@ private:
     std::list<edit_info> edit_info_list_;
 
     bool auto_reset_stay_constants_;
+    bool parametric_;
+    bool speculative_;
     bool needs_solving_;
     bool explain_failure_;
 
+    // A resolve_for() ran out of budget, and the tableau is halfway
+    // between two bases.
+    bool resolving_;
+
     std::stack<size_t> cedcns_;
+
+    // The state of the solver at every begin_transaction().
+    std::vector<std::shared_ptr<const simplex_solver>> transactions_;
+
+    // The variables that are likely to be edited.
+    variable_set edit_hints_;
+
+    // The constraints this solver shares with the prototype of a
+    // constraint_model, which must not be changed.
+    std::shared_ptr<const std::unordered_set<constraint>> frozen_;
+
+    // The affine map used by resolve() in parametric mode.  As long as
+    // the tableau is at the given version, the constants of the rows
+    // that depend on the edit constants are
+    //     constants + coeffs * (edit constants - at)
+    // where coeffs is stored row by row.
+    struct parametric_map
+    {
+        parametric_map()
+            : valid{false}
+            , version{0}
+        {
+        }
+
+        bool valid;
+        size_t version;
+        std::vector<edit_info*> edits;
+        std::vector<double> at;
+        std::vector<variable> vars;
+        std::vector<linear_expression*> exprs;
+        std::vector<double> constants;
+        std::vector<double> coeffs;
+        std::vector<size_t> restricted;
+        std::vector<size_t> stays;
+        std::vector<size_t> externals;
+        std::vector<double> delta;
+        std::vector<double> scratch;
+    };
+    parametric_map pmap_;
+
+    // A copy of the tableau at a basis that was optimal once.  The
+    // constants are not used, they are recalculated when the basis is
+    // restored.
+    struct cached_basis
+    {
+        size_t signature;
+        size_t bytes;
+        cow_ptr<rows_map> rows;
+        cow_ptr<columns_map> columns;
+        variable_set external_rows;
+        variable_set external_parametric_vars;
+    };
+    std::list<cached_basis> basis_cache_;
+    size_t basis_cache_budget_;
+    size_t basis_cache_bytes_;
+    size_t basis_cache_hits_;
+    size_t basis_cache_misses_;
+
+    // Scratch space for suggest_values(), kept around so the buckets can
+    // be reused from one call to the next.
+    struct suggested_value
+    {
+        double value;
+        bool found;
+    };
+    std::unordered_map<variable, suggested_value> suggested_;
+    std::unordered_map<variable, double> row_deltas_;
+
+    // Required linear constraints that own a row, indexed by the hash of
+    // their normalized expression.
+    std::unordered_multimap<size_t, constraint> required_index_;
+
+    // Duplicate constraints that share the row of another constraint.
+    // The row is handed over to the next duplicate if its owner is
+    // removed, and only dropped when the last one is gone.
+    std::unordered_map<constraint, constraint_list> duplicates_;
+    std::unordered_map<constraint, constraint> shared_rows_;
+
+    // Required constraints that are implied by the required equalities in
+    // the tableau, along with the equalities they follow from.  They are
+    // added again when one of those is removed.
+    std::unordered_map<constraint, constraint_list> implied_;
+
+    // The range of an external variable, as far as it is known from the
+    // required constraints that only involve that single variable.
+    struct var_bounds
+    {
+        var_bounds()
+            : lower{-std::numeric_limits<double>::infinity()}
+            , upper{std::numeric_limits<double>::infinity()}
+        {
+        }
+
+        double lower;
+        double upper;
+        constraint_list constraints;
+    };
+    std::unordered_map<variable, var_bounds> bounds_;
 };
 
 /** Scoped edit action.
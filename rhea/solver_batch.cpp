@@ -0,0 +1,20 @@
+//---------------------------------------------------------------------------
+// solver_batch.cpp
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#include "solver_batch.hpp"
+
+namespace rhea
+{
+
+void resolve_batches(thread_pool& pool, const std::vector<edit_batch>& batches)
+{
+    pool.run(batches.size(), [&](size_t i) {
+        const edit_batch& b = batches[i];
+        b.solver->suggest_values(b.vars, b.values);
+        b.solver->resolve();
+    });
+}
+
+} // namespace rhea
@@ -0,0 +1,36 @@
+//---------------------------------------------------------------------------
+/// \file   solver_batch.hpp
+/// \brief  Resolve many independent solvers on a thread pool
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#pragma once
+
+#include <vector>
+
+#include "simplex_solver.hpp"
+#include "thread_pool.hpp"
+
+namespace rhea
+{
+
+/** New values for the edit variables of one solver. */
+struct edit_batch
+{
+    simplex_solver* solver;
+    std::vector<variable> vars;
+    std::vector<double> values;
+};
+
+/** Suggest new values to a lot of solvers, and resolve them.
+ * The batches are handed out to the threads of the pool one at a time,
+ * so a few big solvers don't hold up the rest.  Solvers share no
+ * state, but every solver can only appear once in \a batches.  The
+ * variables have to be edit variables of their solver already, see
+ * simplex_solver::suggest_values().  If one of the batches fails, the
+ * others are still resolved, and the exception of the first one that
+ * failed is rethrown. */
+void resolve_batches(thread_pool& pool,
+                     const std::vector<edit_batch>& batches);
+
+} // namespace rhea
@@ -53,6 +53,9 @@ public:
 
     size_t levels() const { return values_.size(); }
 
+    /** Get the weight of one level; 0 is strong, 2 is weak. */
+    double level(size_t i) const { return values_[i]; }
+
 private:
     std::array<double, 3> values_;
 };
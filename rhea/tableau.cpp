@@ -5,16 +5,21 @@
 //---------------------------------------------------------------------------
 #include "tableau.hpp"
 
+#include <vector>
+
+#include "thread_pool.hpp"
+
 namespace rhea
 {
 
 void tableau::add_row(const variable& var, const linear_expression& expr)
 {
     assert(!var.is_nil());
-    rows_[var] = expr;
+    ++version_;
+    rows_.write()[var] = expr;
     for (auto& p : expr.terms()) {
         const variable& v = p.first;
-        columns_[v].insert(var);
+        write_column(v).insert(var);
         if (v.is_external() && !is_basic_var(v))
             external_parametric_vars_.insert(v);
     }
@@ -26,18 +31,21 @@ void tableau::add_row(const variable& var, const linear_expression& expr)
 bool tableau::remove_column(const variable& var)
 {
     assert(!var.is_nil());
-    auto ic = columns_.find(var);
-    if (ic == columns_.end())
+    ++version_;
+    if (!columns_has_key(var))
         return false;
 
-    for (const variable& v : ic->second)
-        rows_[v].erase(var);
+    auto& columns = columns_.write();
+    auto ic = columns.find(var);
+    auto& rows = rows_.write();
+    for (const variable& v : *ic->second)
+        rows[v].write().erase(var);
 
     if (var.is_external()) {
         external_rows_.erase(var);
         external_parametric_vars_.erase(var);
     }
-    columns_.erase(ic);
+    columns.erase(ic);
 
     return true;
 }
@@ -45,14 +53,18 @@ bool tableau::remove_column(const variable& var)
 linear_expression tableau::remove_row(const variable& var)
 {
     assert(!var.is_nil());
-    auto ir = rows_.find(var);
-    assert(ir != rows_.end());
-    for (auto& p : ir->second.terms()) {
-        auto ic = columns_.find(p.first);
-        assert(ic != columns_.end());
-        ic->second.erase(var);
-        if (ic->second.empty()) {
-            columns_.erase(ic);
+    ++version_;
+    auto& rows = rows_.write();
+    auto ir = rows.find(var);
+    assert(ir != rows.end());
+    auto& columns = columns_.write();
+    for (auto& p : ir->second->terms()) {
+        auto ic = columns.find(p.first);
+        assert(ic != columns.end());
+        auto& column = ic->second.write();
+        column.erase(var);
+        if (column.empty()) {
+            columns.erase(ic);
             external_parametric_vars_.erase(p.first);
         }
     }
@@ -63,8 +75,8 @@ linear_expression tableau::remove_row(const variable& var)
         external_parametric_vars_.erase(var);
     }
 
-    linear_expression result{std::move(ir->second)};
-    rows_.erase(ir);
+    linear_expression result{std::move(ir->second.write())};
+    rows.erase(ir);
 
     return result;
 }
@@ -72,37 +84,116 @@ linear_expression tableau::remove_row(const variable& var)
 void tableau::substitute_out(const variable& old,
                              const linear_expression& expr)
 {
-    auto ic = columns_.find(old);
-    if (ic == columns_.end())
+    auto ic = columns_->find(old);
+    if (ic == columns_->end())
         return;
 
-    for (auto& v : ic->second) {
-        auto& row = rows_[v];
-        row.substitute_out(old, expr, v, *this);
-        if (v.is_restricted() && row.constant() < 0)
-            infeasible_rows_.insert(v);
+    ++version_;
+    // Hold on to the column; the column map may change while the rows
+    // are updated.
+    cow_ptr<variable_set> column{ic->second};
+    if (is_parallel(column->size())) {
+        substitute_out_parallel(old, expr, *column);
+    } else {
+        for (auto& v : *column) {
+            auto& row = row_expression(v);
+            row.substitute_out(old, expr, v, *this);
+            if (v.is_restricted() && row.constant() < 0)
+                infeasible_rows_.insert(v);
+        }
     }
 
-    columns_.erase(old);
-
-    if (old.is_external()) {
-        if (!columns_[old].empty())
-            external_rows_.insert(old);
+    columns_.write().erase(old);
 
+    if (old.is_external())
         external_parametric_vars_.erase(old);
+}
+
+void tableau::substitute_out_parallel(const variable& old,
+                                      const linear_expression& expr,
+                                      const variable_set& column)
+{
+    struct update
+    {
+        variable v;
+        linear_expression* row;
+        std::vector<linear_expression::change> changes;
+    };
+
+    // Getting the rows can copy them, so that is done up front.
+    std::vector<update> updates;
+    updates.reserve(column.size());
+    for (auto& v : column)
+        updates.push_back({v, &row_expression(v), {}});
+
+    parallel_for(updates.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            updates[i].row->substitute_out(old, expr, updates[i].changes);
+    });
+
+    // Update the columns in the same order as substitute_out() would
+    // have, so the hash tables end up exactly the same.
+    for (auto& u : updates) {
+        for (auto& c : u.changes) {
+            if (c.second)
+                note_added_variable(c.first, u.v);
+            else
+                note_removed_variable(c.first, u.v);
+        }
+        if (u.v.is_restricted() && u.row->constant() < 0)
+            infeasible_rows_.insert(u.v);
     }
 }
 
+bool tableau::is_parallel(size_t n) const
+{
+    return pool_ && pool_->size() > 1 && n >= parallel_threshold_;
+}
+
+void tableau::parallel_for(size_t n,
+                           const std::function<void(size_t, size_t)>& f) const
+{
+    // A few more pieces than threads, so one slow piece doesn't keep
+    // the other threads waiting.
+    size_t pieces = std::min(n, pool_->size() * 4);
+    pool_->run(pieces, [&](size_t i) {
+        f(n * i / pieces, n * (i + 1) / pieces);
+    });
+}
+
 bool tableau::is_valid() const
 {
-    for (auto& r : rows_) {
+    for (auto& c : *columns_) {
+        // Empty columns should have been removed
+        if (c.second->empty())
+            return false;
+
+        for (auto& v : *c.second) {
+            auto ir = rows_->find(v);
+            if (ir == rows_->end()
+                || ir->second->terms().count(c.first) == 0)
+                return false;
+        }
+    }
+
+    for (auto& v : external_parametric_vars_) {
+        if (columns_->count(v) == 0)
+            return false;
+    }
+
+    for (auto& v : external_rows_) {
+        if (rows_->count(v) == 0)
+            return false;
+    }
+
+    for (auto& r : *rows_) {
         const auto& clv = r.first;
         if (clv.is_external()) {
             if (external_rows_.count(clv) == 0)
                 return false;
         }
 
-        auto& expr = r.second;
+        auto& expr = *r.second;
         for (auto& p : expr.terms()) {
             const variable& v = p.first;
             if (v.is_external()) {
@@ -114,24 +205,126 @@ bool tableau::is_valid() const
     return true;
 }
 
+void tableau::replace_variables(
+    const std::unordered_map<variable, variable>& to)
+{
+    if (to.empty())
+        return;
+
+    ++version_;
+    auto replace = [&](const variable& v) {
+        auto i = to.find(v);
+        return i == to.end() ? v : i->second;
+    };
+    auto replace_set = [&](variable_set& s) {
+        variable_set result;
+        for (auto& v : s)
+            result.insert(replace(v));
+        s.swap(result);
+    };
+
+    // Rows and columns that don't mention any of the variables stay
+    // shared with copies of this tableau.
+    rows_map rows;
+    std::vector<linear_expression::term> renamed;
+    for (auto& row : *rows_) {
+        renamed.clear();
+        for (auto& t : row.second->terms()) {
+            if (to.count(t.first) > 0)
+                renamed.push_back(t);
+        }
+        auto i = rows.emplace(replace(row.first), row.second).first;
+        if (renamed.empty())
+            continue;
+
+        linear_expression& expr = i->second.write();
+        for (auto& t : renamed) {
+            expr.erase(t.first);
+            expr.set(replace(t.first), t.second);
+        }
+    }
+    rows_ = std::move(rows);
+
+    columns_map columns;
+    for (auto& col : *columns_) {
+        auto i = columns.emplace(replace(col.first), col.second).first;
+        bool changed = std::any_of(col.second->begin(), col.second->end(),
+                                   [&](const variable& v) {
+            return to.count(v) > 0;
+        });
+        if (changed)
+            replace_set(i->second.write());
+    }
+    columns_ = std::move(columns);
+
+    replace_set(infeasible_rows_);
+    replace_set(external_rows_);
+    replace_set(external_parametric_vars_);
+}
+
+template <typename pred>
+static void purge(variable_set& s, pred keep)
+{
+    for (auto i = s.begin(); i != s.end();) {
+        if (keep(*i))
+            ++i;
+        else
+            i = s.erase(i);
+    }
+    s.rehash(0);
+}
+
+void tableau::shrink_to_fit()
+{
+    auto& columns = columns_.write();
+    for (auto i = columns.begin(); i != columns.end();) {
+        if (i->second->empty())
+            i = columns.erase(i);
+        else
+            ++i;
+    }
+
+    purge(external_parametric_vars_,
+          [&](const variable& v) { return columns.count(v) > 0; });
+    purge(external_rows_, [&](const variable& v) { return is_basic_var(v); });
+    purge(infeasible_rows_, [&](const variable& v) { return is_basic_var(v); });
+
+    // Shared columns are left alone, rather than copied.
+    for (auto& c : columns) {
+        if (c.second.is_unique())
+            c.second.write().rehash(0);
+    }
+
+    columns.rehash(0);
+    rows_.write().rehash(0);
+}
+
 void tableau::note_removed_variable(const variable& v, const variable& subj)
 {
-    auto& column = columns_[v];
+    ++version_;
+    auto& columns = columns_.write();
+    auto ic = columns.find(v);
+    if (ic == columns.end())
+        RHEA_THROW(internal_error(
+            "note_removed_variable: variable not in tableau"));
+
+    auto& column = ic->second.write();
     auto i(column.find(subj));
     if (i == column.end())
-        throw internal_error("note_removed_variable: subject not in column");
+        RHEA_THROW(internal_error(
+            "note_removed_variable: subject not in column"));
 
     column.erase(i);
     if (column.empty()) {
-        columns_.erase(v);
-        external_rows_.erase(v);
+        columns.erase(ic);
         external_parametric_vars_.erase(v);
     }
 }
 
 void tableau::note_added_variable(const variable& v, const variable& subj)
 {
-    columns_[v].insert(subj);
+    ++version_;
+    write_column(v).insert(subj);
     if (v.is_external() && !is_basic_var(v))
         external_parametric_vars_.insert(v);
 }
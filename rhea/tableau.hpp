@@ -6,8 +6,12 @@
 //---------------------------------------------------------------------------
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include <unordered_map>
 #include <iostream>
+#include "copy_on_write.hpp"
 #include "errors.hpp"
 #include "variable.hpp"
 #include "linear_expression.hpp"
@@ -15,6 +19,8 @@
 namespace rhea
 {
 
+class thread_pool;
+
 /** A tableau, or augmented matrix, represents the coefficients and
  ** solution of a set of equations.
  * For example, given the following set of equations:
@@ -47,8 +53,8 @@ namespace rhea
 class tableau
 {
 public:
-    typedef std::unordered_map<variable, variable_set> columns_map;
-    typedef std::unordered_map<variable, linear_expression> rows_map;
+    typedef std::unordered_map<variable, cow_ptr<variable_set>> columns_map;
+    typedef std::unordered_map<variable, cow_ptr<linear_expression>> rows_map;
 
 public:
     /** This function should be invoked when v has been removed from an
@@ -62,8 +68,76 @@ public:
     /** Check the internal consistency of this data structure. */
     bool is_valid() const;
 
+    /** Drop empty columns and stale indices, and give unused memory in
+     ** the hash tables back to the system.
+     * Hash tables never shrink by themselves, so after removing a large
+     * number of constraints it can be worthwhile to call this. */
+    void shrink_to_fit();
+
+    /** Spread the work of large pivots over the threads of a pool.
+     * Substitutions that change at least \a threshold rows, and the
+     * scans of the simplex method over at least that many terms, are
+     * split between the threads.  The results are exactly the same as
+     * without a pool.  The pool is not owned by the tableau.  It can be
+     * shared with other tableaus, and even be running the task that uses
+     * this tableau, in which case the work stays on that task's thread.
+     * \param pool       The pool to use, or null to do everything on
+     *                   the calling thread
+     * \param threshold  The smallest amount of work that is split up */
+    void set_thread_pool(thread_pool* pool, size_t threshold = 1024)
+    {
+        pool_ = pool;
+        parallel_threshold_ = threshold;
+    }
+
+    /** \sa set_thread_pool() */
+    thread_pool* get_thread_pool() const { return pool_; }
+
+    /** \sa set_thread_pool() */
+    size_t parallel_threshold() const { return parallel_threshold_; }
+
 public:
-    tableau() {}
+    tableau()
+        : version_{0}
+        , copies_{std::make_shared<char>()}
+        , pool_{nullptr}
+        , parallel_threshold_{1024}
+    {
+    }
+
+    /** Copy a tableau.
+     * The rows and columns are shared with \a copy until either of them
+     * changes them, so only the index of the rows and columns is
+     * copied, not the rows themselves.  \a copy itself isn't changed,
+     * so several threads can copy the same tableau at once.  The copy
+     * gets a newer version, since the pointers into the rows it took
+     * over from \a copy aren't private. \sa claim_rows() */
+    tableau(const tableau& copy)
+        : columns_(copy.columns_)
+        , rows_(copy.rows_)
+        , infeasible_rows_(copy.infeasible_rows_)
+        , external_rows_(copy.external_rows_)
+        , external_parametric_vars_(copy.external_parametric_vars_)
+        , version_{copy.version_ + 1}
+        , copies_{copy.copies_}
+        , pool_{copy.pool_}
+        , parallel_threshold_{copy.parallel_threshold_}
+    {
+    }
+
+    tableau& operator=(const tableau& copy)
+    {
+        columns_ = copy.columns_;
+        rows_ = copy.rows_;
+        infeasible_rows_ = copy.infeasible_rows_;
+        external_rows_ = copy.external_rows_;
+        external_parametric_vars_ = copy.external_parametric_vars_;
+        version_ = std::max(version_, copy.version_) + 1;
+        copies_ = copy.copies_;
+        pool_ = copy.pool_;
+        parallel_threshold_ = copy.parallel_threshold_;
+        return *this;
+    }
 
     virtual ~tableau() {}
 
@@ -88,52 +162,107 @@ public:
     void substitute_out(const variable& old_var,
                         const linear_expression& expr);
 
-    const columns_map& columns() const { return columns_; }
+    /** Rename variables throughout the tableau.
+     * Every variable that is a key in \a to is replaced by its value.
+     * The new variables must not already be in the tableau. */
+    void replace_variables(const std::unordered_map<variable, variable>& to);
+
+    const columns_map& columns() const { return *columns_; }
+
+    /** A counter that changes whenever the structure of the tableau
+     ** changes.
+     * Adding or removing a row, a column, or a term all change the
+     * version.  Changing the constant of a row doesn't. */
+    size_t version() const { return version_; }
 
-    const rows_map& rows() const { return rows_; }
+    const rows_map& rows() const { return *rows_; }
 
     bool columns_has_key(const variable& subj) const
     {
-        return columns_.count(subj) > 0;
+        return columns_->count(subj) > 0;
     }
 
     /** Get the linear expression that the given row represents. */
     const linear_expression& row_expression(const variable& v) const
     {
-        auto i = rows_.find(v);
-        if (i == rows_.end())
-            throw row_not_found();
+        auto i = rows_->find(v);
+        if (i == rows_->end())
+            RHEA_THROW(row_not_found());
 
-        return i->second;
+        return *i->second;
     }
 
-    /** Get the linear expression that the given row represents. */
+    /** Get the linear expression that the given row represents, to
+     ** change it.
+     * If the row is shared with a copy of this tableau, it gets a
+     * private copy first.  Use read_row() if it's only read. */
     linear_expression& row_expression(const variable& v)
     {
-        auto i = rows_.find(v);
-        if (i == rows_.end())
-            throw row_not_found();
+        auto& rows = rows_.write();
+        auto i = rows.find(v);
+        if (i == rows.end())
+            RHEA_THROW(row_not_found());
+
+        return i->second.write();
+    }
 
-        return i->second;
+    /** Get the linear expression that the given row represents. */
+    const linear_expression& read_row(const variable& v) const
+    {
+        return row_expression(v);
     }
 
     /** Check if v is one of the basic variables. */
-    bool is_basic_var(const variable& v) const { return rows_.count(v) > 0; }
+    bool is_basic_var(const variable& v) const { return rows_->count(v) > 0; }
 
     /** Check if f is one of the parametric (aka. free) variables. */
     bool is_parametric_var(const variable& v) const
     {
-        return rows_.count(v) == 0;
+        return rows_->count(v) == 0;
     }
 
 protected:
+    /** Make sure that pointers into the rows can be written through.
+     * Copying a tableau doesn't change the original, so after a copy,
+     * the rows that the original has pointers to may be shared with the
+     * copy.  If this tableau has been copied since the last call, the
+     * version changes, so those pointers get looked up again with
+     * row_expression(), which makes the rows private. */
+    void claim_rows()
+    {
+        if (copies_.use_count() > 1) {
+            copies_ = std::make_shared<char>();
+            ++version_;
+        }
+    }
+
+    /** Check if \a n pieces of work are worth splitting up.
+     ** \sa set_thread_pool() */
+    bool is_parallel(size_t n) const;
+
+    /** Split the range [0, n) in pieces, and call \a f(begin, end) for
+     ** every piece on the thread pool. */
+    void parallel_for(size_t n,
+                      const std::function<void(size_t, size_t)>& f) const;
+
+    /** substitute_out(), with the rows changed on the thread pool. */
+    void substitute_out_parallel(const variable& old_var,
+                                 const linear_expression& expr,
+                                 const variable_set& column);
+
+    /** Get a column to change it, creating it if necessary. */
+    variable_set& write_column(const variable& v)
+    {
+        return columns_.write()[v].write();
+    }
+
     /** A mapping from variables which occur in expressions to the
      ** rows whose expressions contain them. */
-    columns_map columns_;
+    cow_ptr<columns_map> columns_;
 
     /** A mapping from the basic variables to the expressions for that
      ** row in the tableau. */
-    rows_map rows_;
+    cow_ptr<rows_map> rows_;
 
     /** The collection of basic variables that have infeasible rows.
      *  This is used internally when optimizing. */
@@ -144,6 +273,16 @@ protected:
 
     /** A map to quickly find rows with external parametric variables. */
     variable_set external_parametric_vars_;
+
+    /** \sa version() */
+    size_t version_;
+
+    /** Shared by a tableau and its copies.  \sa claim_rows() */
+    std::shared_ptr<const char> copies_;
+
+    /** \sa set_thread_pool() */
+    thread_pool* pool_;
+    size_t parallel_threshold_;
 };
 
 } // namespace rhea
@@ -0,0 +1,155 @@
+//---------------------------------------------------------------------------
+// thread_pool.cpp
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#include "thread_pool.hpp"
+
+#include "errors.hpp"
+
+namespace rhea
+{
+
+namespace
+{
+
+// The pools whose tasks are running on this thread, innermost first.
+struct active_pool
+{
+    const thread_pool* pool;
+    const active_pool* outer;
+};
+
+thread_local const active_pool* active_pools = nullptr;
+
+bool is_active(const thread_pool* pool)
+{
+    for (auto a = active_pools; a; a = a->outer) {
+        if (a->pool == pool)
+            return true;
+    }
+    return false;
+}
+
+} // anonymous namespace
+
+thread_pool::thread_pool(size_t size)
+    : task_{nullptr}
+    , count_{0}
+    , next_{0}
+    , running_{0}
+    , batch_{0}
+    , stop_{false}
+    , failed_{0}
+{
+    for (size_t i = 1; i < size; ++i)
+        workers_.emplace_back([this] { work(); });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    for (auto& t : workers_)
+        t.join();
+}
+
+void thread_pool::run(size_t count, const std::function<void(size_t)>& task)
+{
+    // Waiting for the pool from one of its own tasks would never end.
+    if (is_active(this)) {
+        run_in_place(count, task);
+        return;
+    }
+
+    std::lock_guard<std::mutex> turn(turn_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = &task;
+    count_ = count;
+    next_ = 0;
+    failed_ = count;
+    error_ = nullptr;
+    ++batch_;
+    if (!workers_.empty() && count > 1)
+        start_.notify_all();
+
+    help(lock);
+    done_.wait(lock, [this] { return running_ == 0; });
+    task_ = nullptr;
+
+#if RHEA_HAS_EXCEPTIONS
+    if (error_)
+        std::rethrow_exception(error_);
+#endif
+}
+
+void thread_pool::run_in_place(size_t count,
+                               const std::function<void(size_t)>& task)
+{
+#if RHEA_HAS_EXCEPTIONS
+    std::exception_ptr error;
+    for (size_t i = 0; i < count; ++i) {
+        try {
+            task(i);
+        }
+        catch (...) {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+#else
+    for (size_t i = 0; i < count; ++i)
+        task(i);
+#endif
+}
+
+void thread_pool::work()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t seen = batch_;
+    for (;;) {
+        start_.wait(lock, [&] { return stop_ || batch_ != seen; });
+        if (stop_)
+            return;
+
+        seen = batch_;
+        help(lock);
+    }
+}
+
+void thread_pool::help(std::unique_lock<std::mutex>& lock)
+{
+    while (next_ < count_) {
+        size_t i = next_++;
+        ++running_;
+        lock.unlock();
+        active_pool frame{this, active_pools};
+        active_pools = &frame;
+#if RHEA_HAS_EXCEPTIONS
+        try {
+            (*task_)(i);
+        }
+        catch (...) {
+            lock.lock();
+            if (i < failed_) {
+                failed_ = i;
+                error_ = std::current_exception();
+            }
+            lock.unlock();
+        }
+#else
+        (*task_)(i);
+#endif
+        active_pools = frame.outer;
+        lock.lock();
+        if (--running_ == 0 && next_ == count_)
+            done_.notify_all();
+    }
+}
+
+} // namespace rhea
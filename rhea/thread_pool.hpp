@@ -0,0 +1,77 @@
+//---------------------------------------------------------------------------
+/// \file   thread_pool.hpp
+/// \brief  A fixed set of threads that run a batch of tasks
+//
+// Copyright 2012-2014, nocte@hippie.nu       Released under the MIT License.
+//---------------------------------------------------------------------------
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rhea
+{
+
+/** A fixed set of threads that run a batch of tasks.
+ * The calling thread takes part in running the batch, so a pool of
+ * size 1 has no threads of its own and runs everything in place. */
+class thread_pool
+{
+public:
+    /** \param size  The number of tasks that can run at the same time */
+    explicit thread_pool(size_t size);
+
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    size_t size() const { return workers_.size() + 1; }
+
+    /** Run task(0) to task(count - 1), and wait until they are done.
+     * The order in which the tasks run is not specified.  If tasks
+     * throw, the exception of the task with the lowest index is
+     * rethrown once all tasks have finished.
+     *
+     * Several threads can call this at the same time; their batches
+     * take turns.  A task can call run() on the same pool as well, for
+     * instance when the solvers of a partitioned_solver share a pool for
+     * their pivots.  Since the threads are busy with the outer batch,
+     * such a batch is run in place, on the thread of the task. */
+    void run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    void work();
+
+    // Run a batch on the calling thread alone.
+    static void run_in_place(size_t count,
+                             const std::function<void(size_t)>& task);
+
+    // Run tasks of the current batch until there are none left.
+    void help(std::unique_lock<std::mutex>& lock);
+
+private:
+    std::vector<std::thread> workers_;
+    // Held by run() for a whole batch.
+    std::mutex turn_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+
+    const std::function<void(size_t)>* task_;
+    size_t count_;
+    size_t next_;
+    size_t running_;
+    size_t batch_;
+    bool stop_;
+
+    size_t failed_;
+    std::exception_ptr error_;
+};
+
+} // namespace rhea
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <cassert>
+#include <functional>
 #include <memory>
 #include <set>
 #include <string>
@@ -220,7 +221,7 @@ public:
 
     /** Calculate a hash value.
      *  This function is only used for placing variables in hash tables. */
-    size_t hash() const { return id(); }
+    size_t hash() const { return std::hash<std::uint64_t>()(id()); }
 
     /** Get a string representation.
      *  For ordinary variables, this will be the value.  Special variables
@@ -248,7 +249,7 @@ public:
 
     /** Get the variable's unique ID.
      *  Do not use: this function may disappear in future versions. */
-    size_t id() const { return p_->id(); }
+    std::uint64_t id() const { return p_->id(); }
 
 private:
     struct nil_
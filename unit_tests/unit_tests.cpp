@@ -3,7 +3,10 @@
 #define BOOST_TEST_MODULE rhea
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <random>
+#include <thread>
 #include <boost/range/algorithm.hpp>
 
 #include "../rhea/simplex_solver.hpp"
@@ -11,6 +14,14 @@
 #include "../rhea/iostream.hpp"
 #include "../rhea/errors_expl.hpp"
 #include "../rhea/link_variable.hpp"
+#include "../rhea/slack_variable.hpp"
+#include "../rhea/compiled_layout.hpp"
+#include "../rhea/constraint_model.hpp"
+#include "../rhea/partitioned_solver.hpp"
+#include "../rhea/nested_solver.hpp"
+#include "../rhea/solver_batch.hpp"
+#include "../rhea/async_solver.hpp"
+#include "../rhea/command_queue.hpp"
 
 using namespace rhea;
 
@@ -1027,3 +1038,1429 @@ BOOST_AUTO_TEST_CASE(independent_values_can_be_suggested_for_concurrent_edits)
     s.change_strength(e1, strength::weak());
     BOOST_CHECK_EQUAL(v.value(), 21);
 }
+
+BOOST_AUTO_TEST_CASE(duplicate_constraints_share_a_row)
+{
+    variable x(0);
+    simplex_solver solver;
+
+    constraint c1{x == 10}, c2{x * 2 == linear_expression(20)},
+        c3{linear_expression(10) == x};
+    solver.add_constraint(c1);
+    auto rows = solver.rows().size();
+    auto columns = solver.columns().size();
+
+    solver.add_constraints({c2, c3});
+    BOOST_CHECK_EQUAL(solver.rows().size(), rows);
+    BOOST_CHECK_EQUAL(solver.columns().size(), columns);
+    BOOST_CHECK(solver.is_redundant(c2));
+    BOOST_CHECK(solver.is_redundant(c3));
+    BOOST_CHECK(solver.contains_constraint(c2));
+    BOOST_CHECK(solver.is_constraint_satisfied(c2));
+
+    // The row is handed over to the remaining duplicates
+    solver.remove_constraint(c1);
+    BOOST_CHECK(!solver.contains_constraint(c1));
+    BOOST_CHECK(!solver.is_redundant(c2) || !solver.is_redundant(c3));
+    BOOST_CHECK_THROW(solver.add_constraint(x == 5), required_failure);
+
+    solver.remove_constraint(c3);
+    solver.remove_constraint(c2);
+    solver.add_constraint(x == 5);
+    BOOST_CHECK_EQUAL(x.value(), 5);
+    BOOST_CHECK(solver.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(implied_constraints_do_not_get_a_row)
+{
+    variable a(0), b(0), c(0);
+    simplex_solver solver;
+
+    constraint ab{a == b}, bc{b == c}, ac{a == c};
+    solver.add_stays({a, c});
+    solver.add_constraints({ab, bc});
+    auto rows = solver.rows().size();
+
+    solver.add_constraint(ac);
+    BOOST_CHECK(solver.is_redundant(ac));
+    BOOST_CHECK_EQUAL(solver.rows().size(), rows);
+
+    // Once it is no longer implied, it gets a row of its own
+    solver.remove_constraint(bc);
+    BOOST_CHECK(!solver.is_redundant(ac));
+    BOOST_CHECK(solver.contains_constraint(ac));
+
+    solver.suggest(c, 42);
+    BOOST_CHECK_EQUAL(a.value(), 42);
+    BOOST_CHECK_EQUAL(b.value(), 42);
+    BOOST_CHECK(solver.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(implied_constraints_track_what_implies_them)
+{
+    variable x(5), y(0), z(0);
+    simplex_solver solver;
+
+    // A required stay does not imply anything, its row changes along
+    // with the variable.
+    constraint stay{std::make_shared<stay_constraint>(x, strength::required())};
+    constraint x5{x == 5};
+    solver.add_constraint(stay);
+    solver.add_constraint(x5);
+    BOOST_CHECK(!solver.is_redundant(x5));
+
+    solver.add_constraint(x == 10, strength::weak());
+    solver.remove_constraint(stay);
+    BOOST_CHECK_EQUAL(x.value(), 5);
+    BOOST_CHECK(solver.is_constraint_satisfied(x5));
+
+    // Only the constraints that depended on the removed one get a row.
+    constraint yz{y == z}, zx{z == x}, yx{y == x}, z5{z == 5};
+    solver.add_constraints({yz, zx, yx, z5});
+    BOOST_CHECK(solver.is_redundant(yx));
+    BOOST_CHECK(solver.is_redundant(z5));
+
+    solver.remove_constraint(yz);
+    BOOST_CHECK(!solver.is_redundant(yx));
+    BOOST_CHECK(solver.is_redundant(z5));
+    BOOST_CHECK_EQUAL(y.value(), 5);
+    BOOST_CHECK(solver.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(removed_constraints_leave_no_columns_behind)
+{
+    std::vector<variable> v(20);
+    simplex_solver solver;
+    constraint_list cs;
+
+    for (size_t i = 0; i < v.size(); ++i) {
+        cs.emplace_back(v[i] >= (double)i);
+        cs.emplace_back(v[i] == 100, strength::weak());
+        if (i > 0)
+            cs.emplace_back(v[i - 1] + 1 <= v[i], strength::medium());
+    }
+    cs.emplace_back(
+        std::make_shared<stay_constraint>(v[0], strength::required()));
+    solver.add_constraints(cs);
+    solver.add_edit_var(v[5]).suggest_value(v[5], 10).resolve();
+    BOOST_CHECK_THROW(solver.add_constraint(v[3] <= 1), required_failure);
+    BOOST_CHECK(solver.is_valid());
+
+    solver.remove_all_edit_vars();
+    solver.remove_constraints(cs);
+    solver.shrink_to_fit();
+
+    BOOST_CHECK(solver.is_valid());
+    BOOST_CHECK_EQUAL(solver.columns().size(), 0);
+    BOOST_CHECK_EQUAL(solver.rows().size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(bounds_reject_infeasible_constraints)
+{
+    variable x(0), y(0);
+    simplex_solver solver;
+
+    constraint xmin{x >= 10}, ymax{y <= 5};
+    solver.add_constraints({xmin, x <= 20, y >= 0, ymax});
+    auto rows = solver.rows().size();
+
+    BOOST_CHECK_THROW(solver.add_constraint(x + y <= 5), required_failure);
+    BOOST_CHECK_THROW(solver.add_constraint(x == y + 30), required_failure);
+    BOOST_CHECK_EQUAL(solver.rows().size(), rows);
+    BOOST_CHECK(solver.is_valid());
+
+    solver.set_explaining(true);
+    constraint c{x * 2 <= 10};
+    try {
+        solver.add_constraint(c);
+        BOOST_CHECK(false);
+    } catch (required_failure_with_explanation& e) {
+        BOOST_CHECK_EQUAL(e.explanation().size(), 3);
+        BOOST_CHECK(e.explanation().back() == c);
+    }
+
+    // Bounds are recalculated after removing a constraint
+    solver.remove_constraint(xmin);
+    solver.add_constraint(c);
+    BOOST_CHECK_EQUAL(x.value(), 5);
+
+    solver.remove_constraint(ymax);
+    solver.add_constraint(x + y >= 30);
+    BOOST_CHECK(solver.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(implied_bounds_are_unregistered_once)
+{
+    variable x(0), y(0);
+    simplex_solver solver;
+
+    constraint xy{x == y}, y5{y == 5}, x5{x == 5};
+    solver.add_constraints({xy, y5, x5});
+    BOOST_CHECK(solver.is_redundant(x5));
+
+    // x == 5 gets a row of its own, and its bound must not be counted
+    // twice.
+    solver.remove_constraint(y5);
+    solver.remove_constraints({xy, x5});
+
+    solver.add_constraint(x == 6);
+    BOOST_CHECK_EQUAL(x.value(), 6);
+    BOOST_CHECK(solver.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(try_add_constraint_reports_status)
+{
+    variable v(0), w(0), x(0), y(0);
+    simplex_solver solver;
+
+    solver.add_constraints({v >= 10, w >= v, x >= w, y >= x});
+    auto rows = solver.rows().size();
+    auto columns = solver.columns().size();
+
+    constraint_list explanation;
+    constraint c{y <= 5};
+    BOOST_CHECK(solver.try_add_constraint(c, &explanation)
+                == status::required_failure);
+    BOOST_CHECK_EQUAL(explanation.size(), 5);
+    BOOST_CHECK(!solver.contains_constraint(c));
+    BOOST_CHECK(solver.try_remove_constraint(c)
+                == status::constraint_not_found);
+    BOOST_CHECK_EQUAL(solver.rows().size(), rows);
+    BOOST_CHECK_EQUAL(solver.columns().size(), columns);
+    BOOST_CHECK(solver.is_valid());
+    BOOST_CHECK_EQUAL(y.value(), 10);
+
+    variable a(0), b(0);
+    solver.add_constraints({a == w, b == a});
+    explanation.clear();
+    BOOST_CHECK(solver.try_add_constraint(b == w + 1, &explanation)
+                == status::required_failure);
+    BOOST_CHECK_EQUAL(explanation.size(), 3);
+    BOOST_CHECK(solver.try_add_constraint(b == w + 1)
+                == status::required_failure);
+    BOOST_CHECK(solver.is_valid());
+
+    BOOST_CHECK(solver.try_add_constraint(y <= 15) == status::ok);
+
+    // The throwing interface still raises the exception that can carry
+    // an explanation, also when explaining is switched off.
+    BOOST_CHECK(!solver.is_explaining());
+    try {
+        solver.add_constraint(y <= 5);
+        BOOST_CHECK(false);
+    } catch (required_failure_with_explanation& e) {
+        BOOST_CHECK(e.explanation().empty());
+    }
+    solver.set_explaining(true);
+    try {
+        solver.add_constraint(y <= 5);
+        BOOST_CHECK(false);
+    } catch (required_failure_with_explanation& e) {
+        BOOST_CHECK_EQUAL(e.explanation().size(), 5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(required_failure_leaves_solver_optimal)
+{
+    variable w(0), x(5), y(-20), z(-13);
+    simplex_solver solver;
+
+    solver.add_stays({w, x, y, z});
+    solver.add_constraints({y >= z - 14, x >= y - 12, y >= x - 11});
+    solver.add_constraint(x == y, strength::strong());
+    solver.hold_edit_var(w);
+    solver.suggest(w, 15);
+    solver.add_constraint(x >= 500);
+    BOOST_CHECK_EQUAL(y.value(), 500);
+
+    // Looking for a solution pivots the tableau; the solver has to be
+    // optimal again once the constraint has been taken out.
+    BOOST_CHECK(solver.try_add_constraint(x + y <= -1000)
+                == status::required_failure);
+    solver.suggest(w, 13);
+    BOOST_CHECK_EQUAL(w.value(), 13);
+    BOOST_CHECK_EQUAL(x.value(), 500);
+    BOOST_CHECK_EQUAL(y.value(), 500);
+    BOOST_CHECK_EQUAL(z.value(), -13);
+}
+
+BOOST_AUTO_TEST_CASE(try_edit_reports_status)
+{
+    variable x(0), y(0);
+    simplex_solver solver;
+
+    solver.add_constraint(y == x * 2).add_stay(x);
+    BOOST_CHECK(solver.try_begin_edit() == status::edit_misuse);
+    BOOST_CHECK(solver.try_end_edit() == status::edit_misuse);
+    BOOST_CHECK(solver.try_suggest_value(x, 1) == status::edit_misuse);
+    BOOST_CHECK(solver.try_remove_edit_var(x) == status::edit_misuse);
+
+    BOOST_CHECK(solver.try_suggest(x, 10) == status::ok);
+    BOOST_CHECK_EQUAL(x.value(), 10);
+    BOOST_CHECK_EQUAL(y.value(), 20);
+
+    BOOST_CHECK(solver.try_add_edit_var(x) == status::ok);
+    BOOST_CHECK(solver.try_begin_edit() == status::ok);
+    BOOST_CHECK(solver.try_suggest_value(x, 3) == status::ok);
+    BOOST_CHECK(solver.try_end_edit() == status::ok);
+    BOOST_CHECK_EQUAL(y.value(), 6);
+    BOOST_CHECK(solver.try_remove_edit_var(x) == status::edit_misuse);
+}
+
+BOOST_AUTO_TEST_CASE(held_edit_vars_persist)
+{
+    variable x(0), y(0), z(0);
+    simplex_solver solver;
+
+    solver.add_constraint(y == x * 2).add_stays({x, z});
+    solver.hold_edit_var(x).hold_edit_var(x);
+    auto rows = solver.rows().size();
+
+    for (int i = 1; i <= 5; ++i) {
+        solver.suggest(x, i * 10);
+        BOOST_CHECK_EQUAL(x.value(), i * 10);
+        BOOST_CHECK_EQUAL(y.value(), i * 20);
+        BOOST_CHECK_EQUAL(solver.rows().size(), rows);
+    }
+
+    // A regular edit leaves the held one alone.
+    solver.suggest(z, 5);
+    BOOST_CHECK_EQUAL(z.value(), 5);
+    BOOST_CHECK(solver.has_edit_var(x));
+    BOOST_CHECK(!solver.has_edit_var(z));
+
+    solver.suggest({{x, 7}, {z, 1}});
+    BOOST_CHECK_EQUAL(y.value(), 14);
+    BOOST_CHECK_EQUAL(z.value(), 1);
+    BOOST_CHECK(solver.has_edit_var(x));
+
+    solver.release_edit_vars();
+    BOOST_CHECK(!solver.has_edit_var(x));
+    BOOST_CHECK_EQUAL(x.value(), 7);
+    BOOST_CHECK(solver.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(suggest_values_batch)
+{
+    std::vector<variable> v(4);
+    variable sum(0);
+    simplex_solver solver;
+
+    solver.add_constraint(sum == v[0] + v[1] + v[2] + v[3]);
+    solver.add_stays({v[0], v[1], v[2], v[3]});
+    for (auto& x : v)
+        solver.add_edit_var(x);
+
+    solver.begin_edit();
+    double values[] = {1, 2, 3, 4};
+    solver.suggest_values(v.data(), values, 4).resolve();
+    BOOST_CHECK_EQUAL(sum.value(), 10);
+    BOOST_CHECK_EQUAL(v[2].value(), 3);
+
+    solver.suggest_values(v, {10, 20, 30, 40}).resolve();
+    BOOST_CHECK_EQUAL(sum.value(), 100);
+
+    // Nothing changes if one of the variables isn't an edit variable.
+    std::vector<variable> bad{v[0], sum};
+    BOOST_CHECK_THROW(solver.suggest_values(bad, {5, 5}), edit_misuse);
+    BOOST_CHECK(solver.try_suggest_values(bad.data(), values, 2)
+                == status::edit_misuse);
+
+    // So do values that don't match the variables.
+    BOOST_CHECK_THROW(solver.suggest_values(v, {1, 2, 3}), edit_misuse);
+    BOOST_CHECK(solver.try_suggest_values(v, {1, 2, 3, 4, 5})
+                == status::edit_misuse);
+    solver.resolve();
+    BOOST_CHECK_EQUAL(v[0].value(), 10);
+
+    solver.end_edit();
+    BOOST_CHECK_EQUAL(sum.value(), 100);
+    BOOST_CHECK(solver.is_valid());
+}
+
+// A few variables that depend on each other in different ways.
+static void make_chain(simplex_solver& s, const std::vector<variable>& v)
+{
+    s.add_constraints({v[1] == v[0] * 2 + 10, v[2] >= v[1],
+                       v[3] == v[1] + v[2], v[4] <= 100,
+                       v[5] == v[4] - v[0]});
+    s.add_constraint(v[4] == v[3], strength::medium());
+    for (auto& x : v)
+        s.add_stay(x);
+}
+
+// A window of width w, split into a sidebar and the content.
+static void make_sidebar(simplex_solver& s, const variable& w,
+                         const variable& side, const variable& content)
+{
+    s.add_constraints({side >= 150, content >= 300, content == w - side});
+    s.add_constraint(side == w * 0.3, strength::medium());
+    s.add_stays({w, side, content});
+}
+
+// A number of chains that have nothing to do with each other.
+static std::vector<std::vector<variable>> make_islands(solver& s)
+{
+    std::vector<std::vector<variable>> islands;
+    for (int i = 0; i < 6; ++i) {
+        std::vector<variable> chain;
+        for (int j = 0; j < 5; ++j)
+            chain.push_back(variable(i));
+
+        s.add_bounds(chain[0], 0, 1000);
+        for (int j = 1; j < 5; ++j)
+            s.add_constraint(chain[j] >= chain[j - 1] + 10);
+
+        for (auto& v : chain)
+            s.add_stay(v);
+
+        islands.push_back(chain);
+    }
+    return islands;
+}
+
+template <typename T>
+static void edit_island(T& s, const variable& v, double x)
+{
+    s.add_edit_var(v);
+    s.begin_edit();
+    s.suggest_value(v, x);
+    s.resolve();
+    s.end_edit();
+}
+
+BOOST_AUTO_TEST_CASE(hinted_edit_vars_give_same_results)
+{
+    std::vector<variable> a(6), b(6);
+    simplex_solver plain, hinted;
+
+    make_chain(plain, a);
+    make_chain(hinted, b);
+    hinted.hint_edit_var(b[0]);
+    BOOST_CHECK(hinted.is_edit_hint(b[0]));
+
+    plain.add_edit_var(a[0]).begin_edit();
+    hinted.add_edit_var(b[0]).begin_edit();
+    for (int i = 0; i < 40; ++i) {
+        double x = (i % 10) * 7 - 20;
+        plain.suggest_value(a[0], x).resolve();
+        hinted.suggest_value(b[0], x).resolve();
+        for (size_t j = 0; j < a.size(); ++j)
+            BOOST_CHECK_EQUAL(a[j].value(), b[j].value());
+    }
+    plain.end_edit();
+    hinted.end_edit();
+    BOOST_CHECK(hinted.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(parametric_resolve_matches_plain)
+{
+    std::vector<variable> a(6), b(6);
+    simplex_solver plain, fast;
+
+    make_chain(plain, a);
+    make_chain(fast, b);
+    plain.add_constraint(a[0] >= -50);
+    fast.add_constraint(b[0] >= -50);
+    fast.set_parametric();
+    BOOST_CHECK(fast.is_parametric());
+
+    plain.add_edit_var(a[0]).add_edit_var(a[2]).begin_edit();
+    fast.add_edit_var(b[0]).add_edit_var(b[2]).begin_edit();
+    for (int i = 0; i < 60; ++i) {
+        double x = (i % 20 < 10 ? i % 10 : 10 - i % 10) * 9 - 60;
+        plain.suggest_value(a[0], x).suggest_value(a[2], x / 2).resolve();
+        fast.suggest_value(b[0], x).suggest_value(b[2], x / 2).resolve();
+        for (size_t j = 0; j < a.size(); ++j)
+            BOOST_CHECK_CLOSE(a[j].value() + 1000, b[j].value() + 1000, 1e-9);
+
+        auto range = fast.parametric_range(b[0]);
+        BOOST_CHECK(range.first <= b[0].value() + 1e-6);
+        BOOST_CHECK(range.second >= b[0].value() - 1e-6);
+
+        if (i == 30) {
+            // Changing the tableau halfway drops the map.
+            plain.add_constraint(a[5] >= -500);
+            fast.add_constraint(b[5] >= -500);
+            BOOST_CHECK(fast.parametric_range(b[0]).first
+                        > fast.parametric_range(b[0]).second);
+        }
+    }
+    plain.end_edit();
+    fast.end_edit();
+    for (size_t j = 0; j < a.size(); ++j)
+        BOOST_CHECK_CLOSE(a[j].value() + 1000, b[j].value() + 1000, 1e-9);
+
+    BOOST_CHECK(fast.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(basis_cache_jumps_between_breakpoints)
+{
+    variable w1(1000), s1(0), c1(0), w2(1000), s2(0), c2(0);
+    simplex_solver plain, cached;
+
+    make_sidebar(plain, w1, s1, c1);
+    make_sidebar(cached, w2, s2, c2);
+    plain.hold_edit_var(w1);
+    cached.hold_edit_var(w2);
+    cached.set_basis_cache(1 << 20);
+
+    for (int i = 0; i < 10; ++i) {
+        double width = i % 2 == 0 ? 400 : 1000;
+        plain.suggest(w1, width);
+        cached.suggest(w2, width);
+        BOOST_CHECK_CLOSE(s1.value(), s2.value(), 1e-9);
+        BOOST_CHECK_CLOSE(c1.value(), c2.value(), 1e-9);
+    }
+    BOOST_CHECK_CLOSE(s2.value(), 300, 1e-9);
+    BOOST_CHECK(cached.basis_cache_hits() > 0);
+    BOOST_CHECK(cached.basis_cache_size() <= 2);
+    BOOST_CHECK(cached.is_valid());
+
+    cached.suggest(w2, 400);
+    BOOST_CHECK_CLOSE(s2.value(), 150, 1e-9);
+
+    cached.add_constraint(s2 <= 500);
+    BOOST_CHECK_EQUAL(cached.basis_cache_size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(solve_trajectory_matches_sequential)
+{
+    for (bool parametric : {false, true}) {
+        variable w1(1000), s1(0), c1(0), w2(1000), s2(0), c2(0);
+        simplex_solver seq, traj;
+        int calls = 0;
+
+        make_sidebar(seq, w1, s1, c1);
+        make_sidebar(traj, w2, s2, c2);
+        seq.hold_edit_var(w1);
+        traj.hold_edit_var(w2);
+        seq.set_parametric(parametric);
+        traj.set_parametric(parametric);
+
+        std::vector<double> widths;
+        for (int i = 0; i <= 20; ++i)
+            widths.push_back(450 + i * 40);
+
+        traj.on_variable_change = [&](const variable&, simplex_solver&) {
+            ++calls;
+        };
+        auto result = traj.solve_trajectory(w2, widths, {s2, c2});
+        BOOST_CHECK_EQUAL(result.size(), widths.size() * 2);
+        BOOST_CHECK(calls <= 3);
+
+        for (size_t i = 0; i < widths.size(); ++i) {
+            seq.suggest_value(w1, widths[i]).resolve();
+            BOOST_CHECK_CLOSE(result[i * 2], s1.value(), 1e-9);
+            BOOST_CHECK_CLOSE(result[i * 2 + 1], c1.value(), 1e-9);
+        }
+        BOOST_CHECK_CLOSE(s2.value(), s1.value(), 1e-9);
+        BOOST_CHECK_CLOSE(c2.value(), c1.value(), 1e-9);
+        BOOST_CHECK(traj.is_valid());
+
+        variable other;
+        BOOST_CHECK_THROW(traj.solve_trajectory(other, widths, {s2}),
+                          edit_misuse);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compiled_layout_matches_solver)
+{
+    variable w(1000), side(0), content(0);
+    simplex_solver solver;
+    make_sidebar(solver, w, side, content);
+    solver.add_constraint(side <= 400);
+    solver.hold_edit_var(w);
+    double before = side.value();
+
+    compiled_layout layout(solver, {{w, 300, 2000}}, {side, content}, 8);
+    BOOST_CHECK_EQUAL(layout.regions().size(), 3);
+    BOOST_CHECK_EQUAL(side.value(), before);
+    BOOST_CHECK(!solver.is_parametric());
+    BOOST_CHECK(solver.is_valid());
+
+    for (double x = 500; x <= 2500; x += 37) {
+        variable w2(1000), side2(0), content2(0);
+        simplex_solver fresh;
+        make_sidebar(fresh, w2, side2, content2);
+        fresh.add_constraint(side2 <= 400);
+        fresh.hold_edit_var(w2);
+        fresh.suggest(w2, x);
+
+        double out[2];
+        BOOST_CHECK(layout.evaluate(&x, out) >= 0);
+        BOOST_CHECK_CLOSE(out[0] + 1, side2.value() + 1, 1e-9);
+        BOOST_CHECK_CLOSE(out[1] + 1, content2.value() + 1, 1e-9);
+    }
+
+    std::string code = layout.to_cpp("sidebar_layout");
+    BOOST_CHECK(code.find("inline int sidebar_layout(") != std::string::npos);
+    BOOST_CHECK(code.find("return 2;") != std::string::npos);
+
+    variable other;
+    BOOST_CHECK_THROW(compiled_layout(solver, {{other, 0, 1}}, {side}),
+                      edit_misuse);
+
+    // A suggestion that hasn't been resolved yet is kept.
+    solver.suggest_value(w, 1500);
+    compiled_layout again(solver, {{w, 300, 2000}}, {side, content}, 8);
+    BOOST_CHECK_EQUAL(w.value(), 1500);
+    solver.resolve();
+    BOOST_CHECK_EQUAL(side.value(), 400);
+
+    // So are the suggestion and the flags, if something goes wrong
+    // halfway.
+    solver.suggest_value(w, 1200);
+    solver.on_variable_change = [](const variable&, simplex_solver&) {
+        throw std::runtime_error("");
+    };
+    BOOST_CHECK_THROW(compiled_layout(solver, {{w, 300, 2000}}, {side}),
+                      std::runtime_error);
+    BOOST_CHECK_EQUAL(solver.edit_value(w), 1200);
+    BOOST_CHECK(!solver.is_parametric());
+    BOOST_CHECK(solver.is_auto_reset_stay_constants());
+}
+
+BOOST_AUTO_TEST_CASE(constraint_model_instances)
+{
+    variable w(1000), side(0), content(0);
+    simplex_solver prototype;
+    make_sidebar(prototype, w, side, content);
+    constraint limit{side <= 400};
+    prototype.add_constraint(limit);
+    constraint_model model(prototype, {w, side, content});
+
+    std::vector<std::vector<variable>> vars;
+    std::vector<simplex_solver> instances(3);
+    for (size_t i = 0; i < instances.size(); ++i) {
+        vars.push_back({variable(), variable(), variable()});
+        model.instantiate(instances[i], vars[i]);
+        BOOST_CHECK(instances[i].is_valid());
+        BOOST_CHECK_EQUAL(vars[i][1].value(), 150);
+        instances[i].hold_edit_var(vars[i][0]);
+    }
+    instances[1].remove_constraint(limit);
+
+    for (double x : {500.0, 2000.0, 800.0}) {
+        for (size_t i = 0; i < instances.size(); ++i) {
+            instances[i].suggest(vars[i][0], x + i);
+
+            variable w2(1000), side2(0), content2(0);
+            simplex_solver fresh;
+            make_sidebar(fresh, w2, side2, content2);
+            if (i != 1)
+                fresh.add_constraint(side2 <= 400);
+            fresh.hold_edit_var(w2);
+            fresh.suggest(w2, x + i);
+
+            BOOST_CHECK_CLOSE(vars[i][1].value(), side2.value(), 1e-9);
+            BOOST_CHECK_CLOSE(vars[i][2].value(), content2.value(), 1e-9);
+        }
+    }
+    BOOST_CHECK_CLOSE(vars[1][1].value(), 240.3, 1e-9);
+    BOOST_CHECK_EQUAL(side.value(), 150);
+    BOOST_CHECK(instances[0].is_valid());
+
+    std::vector<variable> too_few{variable(), variable()};
+    BOOST_CHECK_THROW(model.instantiate(instances[0], too_few), edit_misuse);
+    std::vector<variable> twice{vars[0][0], vars[0][0], variable()};
+    BOOST_CHECK_THROW(model.instantiate(instances[0], twice), edit_misuse);
+    std::vector<variable> swapped{side, w, content};
+    BOOST_CHECK_THROW(model.instantiate(instances[0], swapped), edit_misuse);
+    BOOST_CHECK(instances[0].is_valid());
+
+    // The constraints of the model are shared by all instances.
+    BOOST_CHECK_THROW(instances[0].change_strength(limit, strength::weak()),
+                      shared_constraint);
+    BOOST_CHECK(limit.get_strength().is_required());
+
+    // Instances can be made from several threads at once.
+    std::vector<simplex_solver> parallel(4);
+    std::vector<std::vector<variable>> parallel_vars(parallel.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < parallel.size(); ++i) {
+        threads.emplace_back([&, i] {
+            parallel_vars[i] = {variable(), variable(), variable()};
+            model.instantiate(parallel[i], parallel_vars[i]);
+            parallel[i].hold_edit_var(parallel_vars[i][0]);
+            parallel[i].suggest(parallel_vars[i][0], 2000);
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    for (auto& v : parallel_vars)
+        BOOST_CHECK_CLOSE(v[1].value(), 400, 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(solve_scenarios_matches_single_solves)
+{
+    auto setup = [](simplex_solver& s, std::vector<variable>& v) {
+        // v: width, sidebar, content, height, header
+        s.add_constraints({v[1] >= 150, v[2] >= 300, v[2] == v[0] - v[1],
+                           v[1] <= 400, v[4] >= 20, v[4] <= v[3]});
+        s.add_constraint(v[1] == v[0] * 0.3, strength::medium());
+        s.add_constraint(v[4] == v[3] * 0.1, strength::medium());
+        for (auto& x : v)
+            s.add_stay(x);
+        s.hold_edit_var(v[0]);
+        s.hold_edit_var(v[3]);
+    };
+
+    std::vector<variable> v{variable(1000), variable(0), variable(0),
+                            variable(800), variable(0)};
+    simplex_solver solver;
+    setup(solver, v);
+    double before = v[1].value();
+
+    std::vector<double> sizes;
+    for (int i = 0; i < 40; ++i) {
+        sizes.push_back(450 + (i * 97) % 1800);
+        sizes.push_back(100 + (i * 53) % 900);
+    }
+    std::vector<variable> outputs{v[1], v[2], v[4]};
+    auto result = solver.solve_scenarios({v[0], v[3]}, sizes, outputs);
+    BOOST_CHECK_EQUAL(result.size(), 40 * 3);
+    BOOST_CHECK_EQUAL(v[1].value(), before);
+    BOOST_CHECK(!solver.is_parametric());
+    BOOST_CHECK(solver.is_valid());
+
+    for (size_t i = 0; i < 40; ++i) {
+        std::vector<variable> f{variable(1000), variable(0), variable(0),
+                                variable(800), variable(0)};
+        simplex_solver fresh;
+        setup(fresh, f);
+        fresh.suggest({{f[0], sizes[i * 2]}, {f[3], sizes[i * 2 + 1]}});
+        BOOST_CHECK_CLOSE(result[i * 3] + 1, f[1].value() + 1, 1e-9);
+        BOOST_CHECK_CLOSE(result[i * 3 + 1] + 1, f[2].value() + 1, 1e-9);
+        BOOST_CHECK_CLOSE(result[i * 3 + 2] + 1, f[4].value() + 1, 1e-9);
+    }
+
+    variable other;
+    BOOST_CHECK_THROW(solver.solve_scenarios({other}, {1.0}, outputs),
+                      edit_misuse);
+    BOOST_CHECK_THROW(solver.solve_scenarios({v[0], v[3]}, {1.0, 2.0, 3.0},
+                                             outputs),
+                      edit_misuse);
+    BOOST_CHECK_THROW(solver.solve_scenarios({}, {1.0}, outputs), edit_misuse);
+}
+
+BOOST_AUTO_TEST_CASE(clone_shares_untouched_rows)
+{
+    std::vector<variable> v(20);
+    simplex_solver solver;
+    for (size_t i = 1; i < v.size(); ++i) {
+        solver.add_constraint(v[i] >= v[i - 1] + 10);
+        solver.add_constraint(v[i] <= 1000);
+    }
+    solver.add_constraint(v[0] >= 0);
+    for (auto& x : v)
+        solver.add_stay(x);
+
+    std::vector<double> before;
+    for (auto& x : v)
+        before.push_back(x.value());
+
+    int calls = 0;
+    solver.on_variable_change = [&](const variable&, simplex_solver&) {
+        ++calls;
+    };
+
+    auto what_if = solver.clone();
+    BOOST_CHECK(what_if.is_speculative());
+    what_if.add_constraint(v[5] <= before[5] - 100);
+    BOOST_CHECK(what_if.is_valid());
+    BOOST_CHECK(what_if.solution_value(v[5]) <= before[5] - 100 + 1e-6);
+    BOOST_CHECK(what_if.solution_value(v[4]) <= before[5] - 110 + 1e-6);
+
+    // The original solver and its variables are untouched.
+    BOOST_CHECK_EQUAL(calls, 0);
+    for (size_t i = 0; i < v.size(); ++i)
+        BOOST_CHECK_EQUAL(v[i].value(), before[i]);
+
+    BOOST_CHECK(solver.is_valid());
+    BOOST_CHECK_EQUAL(solver.solution_value(v[5]), before[5]);
+
+    size_t shared = 0;
+    for (auto& row : solver.rows()) {
+        auto i = what_if.rows().find(row.first);
+        if (i != what_if.rows().end() && &*i->second == &*row.second)
+            ++shared;
+    }
+    BOOST_CHECK(shared > 0);
+    BOOST_CHECK(shared < solver.rows().size());
+
+    // Changing the original afterwards doesn't affect the clone.
+    double speculated = what_if.solution_value(v[12]);
+    solver.add_constraint(v[12] <= before[12] - 50);
+    BOOST_CHECK(v[12].value() <= before[12] - 50 + 1e-6);
+    BOOST_CHECK_EQUAL(what_if.solution_value(v[12]), speculated);
+    BOOST_CHECK(what_if.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(clone_leaves_the_original_alone)
+{
+    variable x(0), y(0);
+    simplex_solver solver;
+    solver.set_parametric();
+    solver.add_constraints({y == x + 5, x <= 1000});
+    solver.add_edit_var(x).begin_edit();
+    solver.suggest_value(x, 20);
+    solver.resolve();
+
+    auto version = solver.version();
+    auto what_if = static_cast<const simplex_solver&>(solver).clone();
+    BOOST_CHECK_EQUAL(solver.version(), version);
+
+    // Even if the clone has stopped sharing the list of rows, the rows
+    // themselves are still shared, and resolving the original must not
+    // write into them.
+    what_if.add_constraint(x >= 0);
+    for (double a : {40.0, 60.0}) {
+        solver.suggest_value(x, a);
+        solver.resolve();
+        BOOST_CHECK_EQUAL(y.value(), a + 5);
+    }
+    BOOST_CHECK_EQUAL(what_if.solution_value(y), 25);
+    BOOST_CHECK(what_if.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(clone_keeps_pending_suggestions)
+{
+    // Values suggested in parametric mode are only applied to the
+    // tableau when it resolves; a copy in between must not lose them.
+    variable x(0), y(0);
+    simplex_solver solver;
+    solver.set_parametric();
+    solver.add_constraints({y == x + 5, x <= 1000});
+    solver.add_edit_var(x).begin_edit();
+    solver.suggest_value(x, 20);
+    solver.resolve();
+    BOOST_CHECK_EQUAL(x.value(), 20);
+
+    solver.suggest_value(x, 30);
+    auto what_if = solver.clone();
+    what_if.resolve();
+    BOOST_CHECK_EQUAL(what_if.solution_value(x), 30);
+    BOOST_CHECK_EQUAL(what_if.solution_value(y), 35);
+    solver.resolve();
+    BOOST_CHECK_EQUAL(x.value(), 30);
+    BOOST_CHECK_EQUAL(y.value(), 35);
+
+    solver.suggest_value(x, 50);
+    simplex_solver copy(solver);
+    copy.on_variable_change = nullptr;
+    copy.suggest_value(x, 60);
+    solver.resolve();
+    BOOST_CHECK_EQUAL(x.value(), 50);
+    BOOST_CHECK_EQUAL(y.value(), 55);
+    copy.resolve();
+    BOOST_CHECK_EQUAL(copy.solution_value(x), 60);
+
+    solver.suggest_value(x, 70);
+    copy = solver;
+    solver.resolve();
+    BOOST_CHECK_EQUAL(x.value(), 70);
+    copy.resolve();
+    BOOST_CHECK_EQUAL(copy.solution_value(y), 75);
+}
+
+BOOST_AUTO_TEST_CASE(transactions_roll_back)
+{
+    variable x(0), y(0), z(0);
+    simplex_solver solver;
+    solver.add_constraints({x >= 10, y == x * 2, z <= 100});
+    solver.add_stays({x, y, z});
+    auto rows = solver.rows().size();
+    auto columns = solver.columns().size();
+    BOOST_CHECK_EQUAL(y.value(), 20);
+
+    BOOST_CHECK(!solver.in_transaction());
+    solver.begin_transaction();
+    BOOST_CHECK(solver.in_transaction());
+    constraint c{x >= 30};
+    solver.add_constraint(c);
+    solver.add_constraint(z == y + 5);
+    BOOST_CHECK_EQUAL(y.value(), 60);
+    BOOST_CHECK_EQUAL(z.value(), 65);
+
+    solver.begin_transaction();
+    solver.remove_constraint(c);
+    solver.add_constraint(x >= 40);
+    BOOST_CHECK_EQUAL(x.value(), 40);
+    solver.rollback();
+    BOOST_CHECK_EQUAL(x.value(), 30);
+    BOOST_CHECK(solver.is_valid());
+
+    solver.rollback();
+    BOOST_CHECK(!solver.in_transaction());
+    BOOST_CHECK_EQUAL(x.value(), 10);
+    BOOST_CHECK_EQUAL(y.value(), 20);
+    BOOST_CHECK_EQUAL(solver.rows().size(), rows);
+    BOOST_CHECK_EQUAL(solver.columns().size(), columns);
+    BOOST_CHECK(solver.is_valid());
+    BOOST_CHECK_THROW(solver.remove_constraint(c), constraint_not_found);
+
+    // A committed transaction stays.
+    solver.begin_transaction();
+    solver.add_constraint(x >= 15);
+    solver.commit();
+    BOOST_CHECK_EQUAL(y.value(), 30);
+    BOOST_CHECK_THROW(solver.commit(), transaction_misuse);
+    BOOST_CHECK_THROW(solver.rollback(), transaction_misuse);
+
+    solver.suggest(x, 50);
+    BOOST_CHECK_EQUAL(y.value(), 100);
+}
+
+BOOST_AUTO_TEST_CASE(partitioned_solver_components)
+{
+    simplex_solver single;
+    partitioned_solver serial, parallel(4);
+    auto a = make_islands(single);
+    auto b = make_islands(serial);
+    auto c = make_islands(parallel);
+    BOOST_CHECK_EQUAL(serial.components(), 6);
+    BOOST_CHECK_EQUAL(parallel.threads(), 4);
+    BOOST_CHECK(serial.component(b[0][0]) != serial.component(b[1][0]));
+    BOOST_CHECK(serial.component(variable()) == nullptr);
+
+    auto check = [&] {
+        for (size_t i = 0; i < a.size(); ++i) {
+            for (size_t j = 0; j < a[i].size(); ++j) {
+                BOOST_CHECK_EQUAL(b[i][j].value(), c[i][j].value());
+                BOOST_CHECK_CLOSE(a[i][j].value() + 1, b[i][j].value() + 1,
+                                  1e-9);
+            }
+        }
+    };
+    check();
+    BOOST_CHECK_EQUAL(b[3][4].value(), 40);
+
+    // Linking two islands merges them, removing the link splits them.
+    constraint link{b[1][4] == b[2][0]};
+    serial.add_constraint(link);
+    BOOST_CHECK_EQUAL(serial.components(), 5);
+    BOOST_CHECK_EQUAL(b[2][4].value(), b[1][4].value() + 40);
+    serial.remove_constraint(link);
+    BOOST_CHECK_EQUAL(serial.components(), 6);
+    BOOST_CHECK(serial.component(b[1][0]) != serial.component(b[2][0]));
+    BOOST_CHECK_THROW(serial.remove_constraint(link), constraint_not_found);
+    constraint link_a{a[1][4] == a[2][0]}, link_c{c[1][4] == c[2][0]};
+    single.add_constraint(link_a).remove_constraint(link_a);
+    parallel.add_constraint(link_c).remove_constraint(link_c);
+    check();
+
+    edit_island(single, a[2][2], 500);
+    edit_island(serial, b[2][2], 500);
+    edit_island(parallel, c[2][2], 500);
+    BOOST_CHECK_EQUAL(c[2][4].value(), 520);
+    check();
+
+    // Components can't be merged while they are being edited.
+    serial.add_edit_var(b[0][0]).add_edit_var(b[3][0]).begin_edit();
+    BOOST_CHECK_THROW(serial.suggest_value(b[1][0], 1), edit_misuse);
+    BOOST_CHECK_THROW(serial.add_constraint(b[0][1] == b[3][1]),
+                      edit_misuse);
+    serial.end_edit();
+    serial.add_constraint(b[0][1] == b[3][1]);
+    BOOST_CHECK_EQUAL(serial.components(), 5);
+
+    // Adding a constraint a second time does nothing.
+    serial.add_constraint(link).add_constraint(link);
+    serial.remove_constraint(link);
+    BOOST_CHECK(!serial.contains_constraint(link));
+    BOOST_CHECK(!serial.component(b[1][0])->contains_constraint(link));
+}
+
+BOOST_AUTO_TEST_CASE(partitioned_solver_lazy)
+{
+    partitioned_solver solver;
+    auto v = make_islands(solver);
+    solver.set_lazy();
+    BOOST_CHECK(solver.is_lazy());
+
+    solver.add_constraint(v[1][0] >= 500);
+    solver.add_edit_var(v[2][4]).begin_edit();
+    solver.suggest_value(v[2][4], 300);
+    solver.resolve();
+    BOOST_CHECK(solver.is_dirty(v[1][0]));
+    BOOST_CHECK(solver.is_dirty(v[2][0]));
+    BOOST_CHECK(!solver.is_dirty(v[3][0]));
+    BOOST_CHECK_EQUAL(v[1][0].value(), 0);
+    BOOST_CHECK_EQUAL(v[2][4].value(), 40);
+
+    // Reading a variable only solves its own component.
+    BOOST_CHECK_EQUAL(solver.value(v[2][4]), 300);
+    BOOST_CHECK(!solver.is_dirty(v[2][0]));
+    BOOST_CHECK(solver.is_dirty(v[1][0]));
+    BOOST_CHECK_EQUAL(v[1][4].value(), 40);
+    BOOST_CHECK_EQUAL(solver.value(v[1][4]), 540);
+    BOOST_CHECK_EQUAL(v[1][0].value(), 500);
+    solver.end_edit();
+
+    // Components are split on demand as well.
+    constraint link{v[3][4] == v[4][0]};
+    solver.add_constraint(link);
+    BOOST_CHECK_EQUAL(solver.components(), 5);
+    solver.remove_constraint(link);
+    solver.add_constraint(v[4][0] >= 100);
+    BOOST_CHECK_EQUAL(solver.value(v[4][0]), 100);
+    BOOST_CHECK_EQUAL(solver.components(), 6);
+    BOOST_CHECK(solver.is_dirty(v[3][0]));
+
+    solver.set_lazy(false);
+    BOOST_CHECK(!solver.is_dirty(v[3][0]));
+    BOOST_CHECK_EQUAL(v[3][4].value(), 40);
+}
+
+BOOST_AUTO_TEST_CASE(nested_solver_boundaries)
+{
+    variable width, lw, rw, a, c, g;
+    nested_solver root;
+    root.set_autosolve(false);
+    root.add_constraint(width == 400);
+    root.add_constraint(lw + rw == width);
+    root.add_constraint(lw == rw, strength::weak());
+
+    nested_solver& left = root.add_child();
+    left.export_variable(a, lw);
+    left.add_constraint(a >= 100);
+
+    nested_solver& right = root.add_child();
+    right.export_variable(c, rw);
+    right.add_constraint(c >= 120);
+
+    nested_solver& inner = right.add_child();
+    inner.export_variable(g, c);
+    inner.add_constraint(g >= 10);
+    BOOST_CHECK(inner.parent() == &right);
+    BOOST_CHECK_EQUAL(root.children().size(), 2);
+
+    // Every container agrees with its parent on the boundary.
+    auto check = [&] {
+        BOOST_CHECK_EQUAL(lw.value() + rw.value(), 400);
+        BOOST_CHECK_EQUAL(a.value(), lw.value());
+        BOOST_CHECK_EQUAL(c.value(), rw.value());
+        BOOST_CHECK_EQUAL(g.value(), c.value());
+    };
+    root.solve();
+    check();
+    BOOST_CHECK(a.value() >= 100);
+    BOOST_CHECK(c.value() >= 120);
+
+    // A change inside a container is passed up, and then down again
+    // into the other containers.
+    root.set_autosolve(true);
+    left.add_constraint(a >= 250);
+    check();
+    BOOST_CHECK(a.value() >= 250);
+    BOOST_CHECK(c.value() >= 120);
+
+    inner.add_constraint(g >= 150);
+    check();
+    BOOST_CHECK_EQUAL(g.value(), 150);
+    BOOST_CHECK_EQUAL(a.value(), 250);
+    BOOST_CHECK(root.container().rows().size() < 20);
+}
+
+BOOST_AUTO_TEST_CASE(resolve_batches_matches_sequential)
+{
+    const size_t count = 40;
+    std::vector<std::unique_ptr<simplex_solver>> solvers, reference;
+    std::vector<std::vector<variable>> vars, ref_vars;
+    auto make = [](std::vector<std::unique_ptr<simplex_solver>>& solvers,
+                   std::vector<std::vector<variable>>& vars) {
+        solvers.emplace_back(new simplex_solver);
+        vars.emplace_back(make_islands(*solvers.back())[0]);
+        solvers.back()->add_edit_var(vars.back()[1]).begin_edit();
+    };
+    for (size_t i = 0; i < count; ++i) {
+        make(solvers, vars);
+        make(reference, ref_vars);
+    }
+
+    thread_pool pool(4);
+    BOOST_CHECK_EQUAL(pool.size(), 4);
+    std::vector<edit_batch> batches;
+    for (size_t i = 0; i < count; ++i) {
+        double x = 100.0 + i * 7;
+        batches.push_back({solvers[i].get(), {vars[i][1]}, {x}});
+        reference[i]->suggest_value(ref_vars[i][1], x).resolve();
+    }
+    resolve_batches(pool, batches);
+
+    for (size_t i = 0; i < count; ++i) {
+        BOOST_CHECK_EQUAL(vars[i][1].value(), 100.0 + i * 7);
+        for (size_t j = 0; j < vars[i].size(); ++j)
+            BOOST_CHECK_EQUAL(vars[i][j].value(), ref_vars[i][j].value());
+    }
+
+    // A failing batch doesn't stop the others.
+    batches[3].vars[0] = variable();
+    batches[5].values[0] = 500;
+    BOOST_CHECK_THROW(resolve_batches(pool, batches), edit_misuse);
+    BOOST_CHECK_EQUAL(vars[5][1].value(), 500);
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_nested_and_concurrent_runs)
+{
+    thread_pool pool(4);
+    std::atomic<int> sum{0};
+
+    // A task can run a batch of its own on the same pool.
+    pool.run(8, [&](size_t i) {
+        pool.run(8, [&](size_t j) { sum += static_cast<int>(i * 8 + j); });
+    });
+    BOOST_CHECK_EQUAL(sum, 64 * 63 / 2);
+
+    // Batches from several threads take turns.
+    sum = 0;
+    std::vector<std::thread> callers;
+    for (int t = 0; t < 4; ++t) {
+        callers.emplace_back([&] {
+            pool.run(100, [&](size_t i) { sum += static_cast<int>(i); });
+        });
+    }
+    for (auto& t : callers)
+        t.join();
+
+    BOOST_CHECK_EQUAL(sum, 4 * 4950);
+}
+
+BOOST_AUTO_TEST_CASE(id_blocks_are_deterministic)
+{
+    // Build the same document twice, once while another thread is busy
+    // creating variables.
+    auto build = [](std::vector<std::uint64_t>& ids,
+                    std::vector<double>& values) {
+        id_block block(42);
+        id_block::scope scope(block);
+        simplex_solver solver;
+        auto islands = make_islands(solver);
+        for (auto& chain : islands) {
+            for (auto& v : chain) {
+                ids.push_back(v.id());
+                values.push_back(v.value());
+            }
+        }
+        for (auto& row : solver.rows())
+            ids.push_back(row.first.id());
+    };
+
+    std::vector<std::uint64_t> ids1, ids2;
+    std::vector<double> values1, values2;
+    build(ids1, values1);
+
+    std::atomic<bool> done{false};
+    std::thread other([&] {
+        while (!done) {
+            simplex_solver solver;
+            make_islands(solver);
+        }
+    });
+    std::thread(build, std::ref(ids2), std::ref(values2)).join();
+    done = true;
+    other.join();
+
+    BOOST_CHECK(ids1 == ids2);
+    BOOST_CHECK(values1 == values2);
+    auto range = std::minmax_element(ids1.begin(), ids1.end());
+    BOOST_CHECK(*range.second - *range.first < id_block::size());
+    BOOST_CHECK(variable().id() < *range.first);
+
+    BOOST_CHECK_THROW(id_block(0), std::out_of_range);
+    BOOST_CHECK_THROW(id_block(id_block::max_index() + 1), std::out_of_range);
+    id_block last(id_block::max_index());
+    id_block::scope scope(last);
+    BOOST_CHECK(variable().id() > *range.second);
+}
+
+BOOST_AUTO_TEST_CASE(async_solver_publishes_snapshots)
+{
+    variable x(0), y(0);
+    constraint soft{y <= 50, strength::weak()};
+    simplex_solver solver;
+    solver.add_constraints({x >= 0, y == x + 10, x <= 1000});
+    solver.add_constraint(soft);
+    solver.add_stays({x, y});
+
+    async_solver async(solver);
+    async.watch(soft);
+    auto first = async.wait();
+    BOOST_CHECK_EQUAL(first->value(y), 10);
+    BOOST_CHECK(first->contains(x));
+    BOOST_CHECK(first->is_satisfied(soft));
+
+    // Readers on other threads only ever see complete solutions.
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    std::thread reader([&] {
+        while (!done) {
+            auto s = async.latest();
+            if (s->value(y) != s->value(x) + 10)
+                ++bad;
+        }
+    });
+    for (int i = 1; i <= 100; ++i)
+        async.suggest(x, i);
+
+    auto last = async.wait();
+    done = true;
+    reader.join();
+    BOOST_CHECK_EQUAL(bad, 0);
+    BOOST_CHECK_EQUAL(last->value(x), 100);
+    BOOST_CHECK_EQUAL(last->value(y), 110);
+    BOOST_CHECK(!last->is_satisfied(soft));
+    BOOST_CHECK(last->generation() > first->generation());
+    BOOST_CHECK_EQUAL(first->value(x), 0);
+
+    async.modify([&](simplex_solver& s) { s.add_constraint(y <= 80); });
+    last = async.wait();
+    BOOST_CHECK_EQUAL(last->value(x), 70);
+
+    // A failing command is reported on its own, and the rest of the
+    // batch is still applied.
+    auto failed = async.modify(
+        [&](simplex_solver& s) { s.add_constraint(x >= 2000); });
+    auto applied
+        = async.modify([&](simplex_solver& s) { s.add_constraint(x <= 60); });
+    async.suggest(x, 50);
+    last = async.wait();
+    BOOST_CHECK_THROW(failed.get(), required_failure);
+    BOOST_CHECK_NO_THROW(applied.get());
+    BOOST_CHECK_EQUAL(last->value(x), 50);
+    BOOST_CHECK_EQUAL(last->value(y), 60);
+}
+
+BOOST_AUTO_TEST_CASE(command_queue_coalesces)
+{
+    variable x, y;
+    simplex_solver solver;
+    command_queue queue;
+    BOOST_CHECK(queue.empty());
+
+    // An impossible constraint that is taken back in the same batch
+    // never reaches the solver.
+    constraint keep{y == x + 10};
+    constraint bad{x == -1};
+    constraint never{x == 1000};
+    queue.add_constraint(keep);
+    queue.add_constraint(bad);
+    queue.add_constraint(never);
+    queue.remove_constraint(never);
+    queue.remove_constraint(bad);
+    BOOST_CHECK(!queue.empty());
+    BOOST_CHECK(queue.drain(solver) == status::ok);
+    BOOST_CHECK(queue.empty());
+    BOOST_CHECK(solver.contains_constraint(keep));
+    BOOST_CHECK(!solver.contains_constraint(bad));
+    BOOST_CHECK(!solver.contains_constraint(never));
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t) {
+        producers.emplace_back([&queue, &x, t] {
+            for (int i = 0; i < 1000; ++i)
+                queue.suggest_value(x, t * 1000 + i);
+        });
+    }
+    for (auto& p : producers)
+        p.join();
+
+    queue.suggest_value(x, 5);
+    BOOST_CHECK(queue.drain(solver) == status::ok);
+    BOOST_CHECK(solver.has_edit_var(x));
+    BOOST_CHECK_EQUAL(x.value(), 5);
+    BOOST_CHECK_EQUAL(y.value(), 15);
+
+    queue.remove_constraint(bad);
+    queue.suggest_value(x, 7);
+    BOOST_CHECK(queue.drain(solver) == status::constraint_not_found);
+    BOOST_CHECK_EQUAL(y.value(), 17);
+
+    // A variable that can't be edited is reported, and the other
+    // suggestions still go through.
+    variable internal{std::make_shared<slack_variable>()};
+    queue.suggest_value(internal, 1);
+    queue.suggest_value(x, 9);
+    BOOST_CHECK(queue.drain(solver) == status::edit_misuse);
+    BOOST_CHECK(queue.empty());
+    BOOST_CHECK_EQUAL(y.value(), 19);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_pivots_match_sequential)
+{
+    // Build the same model twice with the same ids, so the hash tables
+    // iterate in the same order, and solve it with and without a pool.
+    thread_pool pool(4);
+    auto build = [&](thread_pool* p, std::vector<double>& values) {
+        id_block block(7);
+        id_block::scope scope(block);
+        simplex_solver solver;
+        solver.set_thread_pool(p, 8);
+
+        variable w, total;
+        std::vector<variable> x(80);
+        linear_expression sum;
+        for (size_t i = 0; i < x.size(); ++i) {
+            solver.add_constraints({x[i] >= w + i * 0.5, x[i] <= 500});
+            solver.add_constraint(x[i] == 10.0 * i, strength::weak());
+            sum += x[i];
+        }
+        solver.add_constraint(total == sum);
+        solver.add_constraint(total <= 12000, strength::medium());
+
+        solver.add_edit_var(w).begin_edit();
+        for (double s : {0.0, 120.0, 40.0, 390.0, 5.0}) {
+            solver.suggest_value(w, s).resolve();
+            values.push_back(w.value());
+            values.push_back(total.value());
+            for (auto& v : x)
+                values.push_back(v.value());
+        }
+        solver.end_edit();
+        BOOST_CHECK(solver.is_valid());
+    };
+
+    std::vector<double> sequential, parallel;
+    build(nullptr, sequential);
+    build(&pool, parallel);
+    BOOST_CHECK(sequential == parallel);
+    BOOST_CHECK_EQUAL(sequential.size(), 5 * 82);
+}
+
+BOOST_AUTO_TEST_CASE(resolve_for_continues_where_it_stopped)
+{
+    auto build = [](simplex_solver& solver, variable& w,
+                    std::vector<variable>& x) {
+        for (size_t i = 0; i < x.size(); ++i) {
+            solver.add_constraints({x[i] >= w + i * 0.5, x[i] <= 500});
+            solver.add_constraint(x[i] == 10.0 * i, strength::weak());
+        }
+        solver.add_edit_var(w).begin_edit();
+    };
+
+    std::vector<double> expected, values;
+    {
+        id_block block(8);
+        id_block::scope scope(block);
+        simplex_solver solver;
+        variable w;
+        std::vector<variable> x(40);
+        build(solver, w, x);
+        solver.suggest_value(w, 300).resolve();
+        for (auto& v : x)
+            expected.push_back(v.value());
+    }
+
+    id_block block(8);
+    id_block::scope scope(block);
+    simplex_solver solver;
+    variable w;
+    std::vector<variable> x(40);
+    build(solver, w, x);
+
+    solver.suggest_value(w, 300);
+    BOOST_CHECK(solver.resolve_for(1) == status::partial);
+    // The variables keep the last complete solution in the meantime.
+    BOOST_CHECK_EQUAL(w.value(), 0);
+    BOOST_CHECK_EQUAL(x[39].value(), 390);
+    BOOST_CHECK(solver.is_valid());
+
+    int calls = 1;
+    while (solver.resolve_for(1) == status::partial)
+        ++calls;
+
+    BOOST_CHECK(calls > 5);
+    BOOST_CHECK_EQUAL(w.value(), 300);
+    for (auto& v : x)
+        values.push_back(v.value());
+    BOOST_CHECK(values == expected);
+
+    // New values can be suggested while a resolve is unfinished.
+    solver.suggest_value(w, 100);
+    BOOST_CHECK(solver.resolve_for(2) == status::partial);
+    solver.suggest_value(w, 20);
+    BOOST_CHECK(solver.resolve_for(std::chrono::seconds(10)) == status::ok);
+    BOOST_CHECK_EQUAL(w.value(), 20);
+    BOOST_CHECK_EQUAL(x[0].value(), 20);
+    BOOST_CHECK_EQUAL(x[39].value(), 390);
+    BOOST_CHECK(solver.resolve_for(0) == status::ok);
+
+    // Changing the edits or the constraints finishes the resolve first.
+    solver.suggest_value(w, 300);
+    BOOST_CHECK(solver.resolve_for(1) == status::partial);
+    solver.begin_edit();
+    BOOST_CHECK_EQUAL(w.value(), 300);
+    values.clear();
+    for (auto& v : x)
+        values.push_back(v.value());
+    BOOST_CHECK(values == expected);
+    solver.end_edit();
+
+    solver.suggest_value(w, 100);
+    BOOST_CHECK(solver.resolve_for(1) == status::partial);
+    solver.add_constraint(x[0] <= 400);
+    BOOST_CHECK(solver.is_valid());
+    BOOST_CHECK_EQUAL(w.value(), 100);
+    BOOST_CHECK_EQUAL(x[0].value(), 100);
+    BOOST_CHECK_EQUAL(x[39].value(), 390);
+    BOOST_CHECK(solver.resolve_for(0) == status::ok);
+
+    // So does solving.
+    solver.suggest_value(w, 300);
+    BOOST_CHECK(solver.resolve_for(1) == status::partial);
+    solver.solve();
+    BOOST_CHECK_EQUAL(w.value(), 300);
+    values.clear();
+    for (auto& v : x)
+        values.push_back(v.value());
+    BOOST_CHECK(values == expected);
+    BOOST_CHECK(solver.resolve_for(0) == status::ok);
+    BOOST_CHECK(solver.is_valid());
+}
+
+BOOST_AUTO_TEST_CASE(solve_for_one_level_at_a_time)
+{
+    variable a, b, c;
+    auto build = [&](simplex_solver& solver) {
+        solver.set_autosolve(false);
+        solver.add_constraints({a >= 0, b >= 0, c >= 0, a + b + c <= 500});
+        solver.add_constraint(a == 10, strength::strong());
+        solver.add_constraint(b == 20, strength::medium());
+        solver.add_constraint(a == 90, strength::weak());
+        solver.add_constraint(b == 80, strength::weak());
+        solver.add_constraint(c == 30, strength::weak());
+    };
+
+    simplex_solver solver;
+    build(solver);
+    BOOST_CHECK(solver.solve_for(strength::required()) == status::partial);
+    BOOST_CHECK(a.value() + b.value() + c.value() <= 500);
+
+    BOOST_CHECK(solver.solve_for(strength::strong()) == status::partial);
+    BOOST_CHECK_EQUAL(a.value(), 10);
+
+    BOOST_CHECK(solver.solve_for(strength::medium()) == status::partial);
+    BOOST_CHECK_EQUAL(a.value(), 10);
+    BOOST_CHECK_EQUAL(b.value(), 20);
+
+    BOOST_CHECK(solver.solve_for(strength::weak()) == status::ok);
+    BOOST_CHECK_EQUAL(a.value(), 10);
+    BOOST_CHECK_EQUAL(b.value(), 20);
+    BOOST_CHECK_EQUAL(c.value(), 30);
+    BOOST_CHECK(solver.solve_for(strength::strong()) == status::ok);
+    BOOST_CHECK(solver.is_valid());
+
+    // Out of time before the first pivot: the values are feasible, and
+    // solve() finishes the job.
+    simplex_solver late;
+    build(late);
+    auto none = std::chrono::steady_clock::duration::zero();
+    BOOST_CHECK(late.solve_for(strength::weak(), none) == status::partial);
+    BOOST_CHECK(a.value() + b.value() + c.value() <= 500);
+    late.solve();
+    BOOST_CHECK_EQUAL(a.value(), 10);
+    BOOST_CHECK_EQUAL(b.value(), 20);
+    BOOST_CHECK_EQUAL(c.value(), 30);
+}